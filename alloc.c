@@ -1,8 +1,11 @@
 /** @file alloc.c */
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
 #include "debug.h"
 
 /**
@@ -63,6 +66,7 @@ void *calloc(size_t num, size_t size)
  */
 
 static char *_start = NULL;
+static char *_end = NULL; //one past the last byte of the heap
 
 typedef struct _metadata {
 	size_t _size; //the size in bytes of the current block
@@ -72,6 +76,44 @@ typedef struct _metadata {
 
 static metadata *_head = NULL; //the head of the free list structure
 
+/**
+ * Every block handed out is aligned to ALIGNMENT, enough for any type
+ * (alignof(max_align_t)) and for aligned SSE loads and stores.  The header
+ * is not a multiple of ALIGNMENT, so headers sit that far short of an
+ * aligned address and block sizes are rounded to keep the next header
+ * there too.
+ */
+#define ALIGNMENT 16
+
+static size_t _block_size(size_t size)
+{
+	return (size + sizeof(metadata) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT - sizeof(metadata);
+}
+
+/* Extend the heap by a block of size bytes, skipping whatever it takes to align it. */
+static metadata *_grow(size_t size)
+{
+	size_t pad = (ALIGNMENT - ((size_t) sbrk(0) + sizeof(metadata)) % ALIGNMENT) % ALIGNMENT;
+	char *ptr = (char *) sbrk(pad + sizeof(metadata) + size);
+
+	if (ptr == (char *) -1)
+		return NULL;
+
+	metadata *data = (metadata *) (ptr + pad);
+	// Released for alloc_owns(), which reads it without the lock.
+	__atomic_store_n(&_end, (char *) data + sizeof(metadata) + size, __ATOMIC_RELEASE);
+	data->_next = NULL;
+	data->_size = size;
+	return data;
+}
+
+/**
+ * One lock guards the whole heap, so threaded programs can use it.  It is
+ * recursive because realloc() calls malloc() and free(), and under
+ * contest-alloc.so those calls come back in through the shim.
+ */
+static pthread_mutex_t _lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
 /**
  * IMPLEMENTATION PLAN:
  * The head of the free list structure, composed of links of metadata
@@ -87,25 +129,26 @@ static metadata *_head = NULL; //the head of the free list structure
 
 void *malloc(size_t size)
 {
-	if(!_start) //If the heap is empty
-	{	
-		_start = (char *) sbrk(0);
-		char *return_ptr = (char *) sbrk(size+sizeof(metadata));
-		metadata *data = (metadata *) return_ptr;
-		data->_next = NULL;
-		data->_size = size;
-		data->_data_size = size;
-		return_ptr += sizeof(metadata);
-		return return_ptr;
+	// Nothing this big can come from sbrk(), and _block_size() would wrap.
+	if (size > (size_t) -1 / 2)
+	{
+		errno = ENOMEM;
+		return NULL;
 	}
 
+	pthread_mutex_lock(&_lock);
+
+	if(!_start) //If the heap is empty
+		__atomic_store_n(&_start, (char *) sbrk(0), __ATOMIC_RELAXED);
+
+	size_t block_size = _block_size(size);
 	metadata *curr = _head; //We shall use ptr to iterate through the free list
 	metadata *prev = NULL; 	//There is nothing before the head of a list
 	
 	while(curr)
 	{	
 		//if the current free block is big enough to use...
-		if(curr->_size >= size)
+		if(curr->_size >= block_size)
 		{
 			//If curr is other than _head
 			if(prev)
@@ -117,6 +160,7 @@ void *malloc(size_t size)
 		
 			curr->_next = NULL;
 			curr->_data_size = size;
+			pthread_mutex_unlock(&_lock);
 			return (char *) curr + sizeof(metadata);
 		}
 		prev = curr;
@@ -127,11 +171,11 @@ void *malloc(size_t size)
  	 * in the heap large enough for this allocation. We need to make
  	 * the heap larger now.
  	 */
-    char *ptr = (char *) sbrk(size+sizeof(metadata));
-	metadata *data = (metadata *) ptr;
-    data->_size = size;
-	data->_data_size = size;
-    return ptr + sizeof(metadata);
+	metadata *data = _grow(block_size);
+	if (data)
+		data->_data_size = size;
+	pthread_mutex_unlock(&_lock);
+	return data ? (char *) data + sizeof(metadata) : NULL;
 }
 
 
@@ -157,6 +201,8 @@ void free(void *ptr)
 	if (!ptr)
 		return;
 
+	pthread_mutex_lock(&_lock);
+
 	//Look at the metadata for this block.
 	metadata *freed = (metadata *) ( (char *) ptr - sizeof(metadata));
 	freed->_data_size = 0;
@@ -164,11 +210,13 @@ void free(void *ptr)
 	if(!_head)
 	{	
 		_head = freed;
+		pthread_mutex_unlock(&_lock);
 		return;
 	}
 	
 	freed->_next = _head;
 	_head = freed;
+	pthread_mutex_unlock(&_lock);
 	//metadata *curr = _head;
 	//metadata *prev = NULL;
 
@@ -252,6 +300,13 @@ size_t min(size_t a, size_t b)
 {
 	return a < b ? a : b;
 }
+
+/* What realloc() did with each block, for alloc_realloc_stats(). */
+static unsigned long _grown_in_place = 0;
+static unsigned long _shrunk_in_place = 0;
+static unsigned long _moved = 0;
+static unsigned long long _bytes_copied = 0;
+
 void *realloc(void *ptr, size_t size)
 {
 	// "In case that ptr is NULL, the function behaves exactly as malloc()"
@@ -267,18 +322,286 @@ void *realloc(void *ptr, size_t size)
 		return NULL;
 	}
 	
+	pthread_mutex_lock(&_lock);
+
 	//void *return_ptr = malloc(size);
 	metadata *data = (metadata *) ((char *) ptr - sizeof(metadata));
 	size_t old_size = data->_data_size;
 	
-	if(size >= data->_data_size && size <= data->_size)
+	// Resizing to the size the block already has does nothing, and is not counted.
+	if (size == old_size)
 	{
+		pthread_mutex_unlock(&_lock);
+		return ptr;
+	}
+
+	// Any new size that fits in the block keeps it where it is, smaller ones too.
+	if (size <= data->_size)
+	{
+		if (size > old_size)
+			_grown_in_place++;
+		else
+			_shrunk_in_place++;
+
 		data->_data_size = size;
+		pthread_mutex_unlock(&_lock);
 		return ptr;
 	}
 	
 	void* return_ptr = malloc(size);
+	if (!return_ptr)
+	{
+		// The old block is left as it was, as the contract above promises.
+		pthread_mutex_unlock(&_lock);
+		return NULL;
+	}
+
 	memmove(return_ptr, ptr, min(old_size, size));
 	free(ptr);
+
+	_moved++;
+	_bytes_copied += min(old_size, size);
+	pthread_mutex_unlock(&_lock);
 	return return_ptr;
 }
+
+
+/**
+ * Allocate aligned memory block
+ *
+ * Allocates size bytes of memory whose address is a multiple of alignment.
+ * A block big enough for the request plus the worst-case padding is taken
+ * with malloc(); the padding in front of the aligned address is split off
+ * and freed as a block of its own, so nothing needs to remember it later
+ * and free() works on the aligned pointer as on any other.
+ *
+ * @param alignment
+ *    Required alignment of the returned address.  Must be a power of two.
+ * @param size
+ *    Size of the memory block, in bytes.
+ *
+ * @return
+ *    A pointer to the memory block allocated by the function, or NULL if
+ *    alignment is not a power of two or the block could not be allocated
+ *    (including when size plus the padding would overflow).
+ *
+ * @see http://man7.org/linux/man-pages/man3/posix_memalign.3.html
+ */
+void *memalign(size_t alignment, size_t size)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)))
+		return NULL;
+
+	// The padded request below must not wrap around to a small block.
+	if (size > (size_t) -1 - alignment - sizeof(metadata))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	char *raw = malloc(size + alignment + sizeof(metadata));
+	if (!raw)
+		return NULL;
+
+	if ((size_t) raw % alignment == 0)
+		return raw;
+
+	/*
+	 * The aligned address must leave room for a header in front of it, both
+	 * its own and the one of the padding block before it.  (The header is
+	 * reached through size_t so gcc does not assume malloc()'s result has
+	 * nothing in front of it.)
+	 */
+	metadata *block = (metadata *) ((size_t) raw - sizeof(metadata));
+	char *end = raw + block->_size;
+	char *aligned = raw + sizeof(metadata);
+	aligned += (alignment - (size_t) aligned % alignment) % alignment;
+
+	metadata *data = (metadata *) (aligned - sizeof(metadata));
+	data->_next = NULL;
+	data->_size = end - aligned;
+	data->_data_size = size;
+
+	block->_size = (char *) data - raw;
+	free(raw);
+
+	return aligned;
+}
+
+/**
+ * Allocate aligned memory block (POSIX interface)
+ *
+ * @param memptr
+ *    Where to store the address of the allocated block.
+ * @param alignment
+ *    Required alignment.  Must be a power of two multiple of sizeof(void *).
+ * @param size
+ *    Size of the memory block, in bytes.
+ *
+ * @return
+ *    0 on success, EINVAL if alignment is not valid, or ENOMEM if the block
+ *    could not be allocated.
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	if (alignment == 0 || alignment % sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+
+	void *ptr = memalign(alignment, size);
+	if (!ptr)
+		return ENOMEM;
+
+	*memptr = ptr;
+	return 0;
+}
+
+/**
+ * Allocate aligned memory block (C11 interface)
+ *
+ * @see memalign()
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+/**
+ * Allocate page-aligned memory block
+ *
+ * @see memalign()
+ */
+void *valloc(size_t size)
+{
+	return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+/**
+ * Allocate page-aligned memory block, rounded up to whole pages
+ *
+ * @see memalign()
+ */
+void *pvalloc(size_t size)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	if (size > (size_t) -1 - page_size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	return memalign(page_size, (size + page_size - 1) / page_size * page_size);
+}
+
+/**
+ * Reallocate memory block for an array
+ *
+ * Behaves as realloc(ptr, num * size), but fails instead of overflowing.
+ *
+ * @return
+ *    As realloc(), or NULL with errno set to ENOMEM if num * size overflows.
+ */
+void *reallocarray(void *ptr, size_t num, size_t size)
+{
+	if (size && num > (size_t) -1 / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return realloc(ptr, num * size);
+}
+
+/**
+ * Obtain size of memory block
+ *
+ * @param ptr
+ *    Pointer to a memory block previously allocated with malloc(), calloc()
+ *    or realloc().
+ *
+ * @return
+ *    The number of usable bytes in the block, which may be more than were
+ *    requested, or 0 if ptr is NULL.
+ */
+size_t malloc_usable_size(void *ptr)
+{
+	if (!ptr)
+		return 0;
+
+	metadata *data = (metadata *) ((char *) ptr - sizeof(metadata));
+	return data->_size;
+}
+
+/**
+ * Test whether a block belongs to this allocator
+ *
+ * Every block is carved out of the single sbrk() region that starts at
+ * _start, so this is one range check.  Callers that mix this allocator with
+ * another one (such as contest-alloc.so, which must send pointers libc
+ * handed out before it was loaded back to libc) use it to route free().
+ *
+ * It is called on every free() and does not take _lock.  _end is read with
+ * acquire, pairing with the release store in _grow(), and _start is stored
+ * before _end ever is, so a block handed over by another thread is always
+ * seen as owned, however far the heap has grown since.
+ *
+ * @param ptr
+ *    Any pointer.
+ *
+ * @return
+ *    Nonzero if ptr lies within this allocator's heap.
+ */
+int alloc_owns(void *ptr)
+{
+	char *end = __atomic_load_n(&_end, __ATOMIC_ACQUIRE);
+	char *start = __atomic_load_n(&_start, __ATOMIC_RELAXED);
+
+	return (char *) ptr >= start && (char *) ptr < end;
+}
+
+/**
+ * Size a block was last asked for
+ *
+ * malloc_usable_size() gives the whole block; this is the size passed to
+ * the call that allocated or last resized it.  contest-alloc.so uses it to
+ * tell a realloc() that grew a block in place from one that shrank it.
+ *
+ * @param ptr
+ *    A block allocated by this allocator, or NULL.
+ *
+ * @return
+ *    The size requested for the block, or 0 for NULL.
+ */
+size_t alloc_requested_size(void *ptr)
+{
+	if (!ptr)
+		return 0;
+
+	metadata *data = (metadata *) ((char *) ptr - sizeof(metadata));
+	return data->_data_size;
+}
+
+/**
+ * Report what realloc() has done
+ *
+ * Counts every realloc() of an existing block by outcome since the program
+ * started.  Grown and shrunk compare the new size with the size the block
+ * was last asked for; a realloc() to that same size is not counted.  contest-alloc.so reports these through mcontest, and testers
+ * can look the function up with dlsym() to report them too.
+ *
+ * @param grown
+ *    Where to store the number of blocks grown without moving them.
+ * @param shrunk
+ *    Where to store the number of blocks shrunk without moving them.
+ * @param moved
+ *    Where to store the number of blocks moved to a new address.
+ * @param copied
+ *    Where to store the total number of bytes copied by those moves.
+ */
+void alloc_realloc_stats(unsigned long *grown, unsigned long *shrunk, unsigned long *moved, unsigned long long *copied)
+{
+	pthread_mutex_lock(&_lock);
+	*grown = _grown_in_place;
+	*shrunk = _shrunk_in_place;
+	*moved = _moved;
+	*copied = _bytes_copied;
+	pthread_mutex_unlock(&_lock);
+}
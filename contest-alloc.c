@@ -16,6 +16,16 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <malloc.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/syscall.h>
+
+extern void *__sbrk(intptr_t increment);
+extern void *__mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+extern int __munmap(void *addr, size_t length);
 
 static void *alloc_handle = NULL;
 
@@ -24,10 +34,21 @@ static void *(*alloc_malloc)(size_t size) = NULL;
 static void  (*alloc_free)(void *ptr) = NULL;
 static void *(*alloc_realloc)(void *ptr, size_t size) = NULL;
 
+/* Optional: alloc.so need not provide these. */
+static void *(*alloc_memalign)(size_t alignment, size_t size) = NULL;
+static void *(*alloc_aligned_alloc)(size_t alignment, size_t size) = NULL;
+static int   (*alloc_posix_memalign)(void **memptr, size_t alignment, size_t size) = NULL;
+static size_t (*alloc_malloc_usable_size)(void *ptr) = NULL;
+static int   (*alloc_owns)(void *ptr) = NULL;
+static size_t (*alloc_requested_size)(void *ptr) = NULL;
+static void  (*alloc_realloc_stats)(unsigned long *grown, unsigned long *shrunk, unsigned long *moved, unsigned long long *copied) = NULL;
+
 static void *(*libc_calloc)(size_t nmemb, size_t size) = NULL;
 static void *(*libc_malloc)(size_t size) = NULL;
 static void (*libc_free)(void *ptr) = NULL;
 static void *(*libc_realloc)(void *ptr, size_t size) = NULL;
+static void *(*libc_memalign)(size_t alignment, size_t size) = NULL;
+static size_t (*libc_malloc_usable_size)(void *ptr) = NULL;
 
 static void *sbrk_start = 0;
 static void *sbrk_largest = 0;
@@ -38,12 +59,496 @@ static alloc_stats_t *stats = NULL;
 static int inside_init = 0;
 
 
+/*
+ * Per-call tracking has to be cheap, or it distorts the times it reports.
+ * Each thread adds up its own counters and publishes them to the shared
+ * stats only every PUBLISH_INTERVAL calls, when it exits, and at process
+ * exit.  The heap extent only changes in sbrk()/brk() and in the anonymous
+ * mmap()/munmap()/mremap() calls alloc.so makes, which go through the
+ * versions below, so it is tracked there instead of calling sbrk(0) on
+ * every operation.
+ */
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+static TLS unsigned long long local_heap_sum = 0;
+static TLS unsigned long local_uses = 0;
+static TLS int local_registered = 0;
+static TLS long long local_live_bytes = 0;
+static TLS unsigned long local_op_counts[OP_TYPES];
+static TLS unsigned long local_latency[LATENCY_BUCKETS];
+static TLS unsigned long local_sizes[SIZE_BUCKETS];
+static TLS unsigned long local_resizes[RESIZE_BUCKETS][RESIZE_BUCKETS];
+static TLS unsigned long local_realloc_outcomes[REALLOC_OUTCOMES];
+static TLS unsigned long long local_realloc_copied = 0;
+static TLS int local_resized = 0;
+
+/*
+ * alloc.so's own calls to malloc() and free() (from realloc(), calloc() or
+ * memalign()) come back through the shim.  They still count towards the
+ * heap average, as they always have, but the call counts, live bytes and
+ * latencies are only for the calls the program made.
+ */
+static TLS int local_depth = 0;
+
+static pthread_key_t publish_key;
+static void *volatile heap_top = 0;
+static long long mapped_bytes = 0;
+static volatile int heap_limit_exceeded = 0;
+
+static void contest_publish()
+{
+	int i;
+
+	__atomic_fetch_add(&stats->memory_heap_sum, local_heap_sum, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->memory_uses, local_uses, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->live_bytes, local_live_bytes, __ATOMIC_RELAXED);
+	local_heap_sum = 0;
+	local_uses = 0;
+	local_live_bytes = 0;
+
+	for (i = 0; i < OP_TYPES; i++)
+	{
+		if (local_op_counts[i])
+			__atomic_fetch_add(&stats->op_counts[i], local_op_counts[i], __ATOMIC_RELAXED);
+		local_op_counts[i] = 0;
+	}
+
+	for (i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		if (local_latency[i])
+			__atomic_fetch_add(&stats->latency_histogram[i], local_latency[i], __ATOMIC_RELAXED);
+		local_latency[i] = 0;
+	}
+
+	for (i = 0; i < SIZE_BUCKETS; i++)
+	{
+		if (local_sizes[i])
+			__atomic_fetch_add(&stats->size_histogram[i], local_sizes[i], __ATOMIC_RELAXED);
+		local_sizes[i] = 0;
+	}
+
+	/* Most programs never call realloc(); skip all this for them. */
+	if (local_resized)
+	{
+		for (i = 0; i < REALLOC_OUTCOMES; i++)
+		{
+			if (local_realloc_outcomes[i])
+				__atomic_fetch_add(&stats->realloc_outcomes[i], local_realloc_outcomes[i], __ATOMIC_RELAXED);
+			local_realloc_outcomes[i] = 0;
+		}
+		__atomic_fetch_add(&stats->realloc_copied, local_realloc_copied, __ATOMIC_RELAXED);
+		local_realloc_copied = 0;
+
+		unsigned long *resizes = &local_resizes[0][0];
+		unsigned long *shared = &stats->resize_histogram[0][0];
+
+		for (i = 0; i < RESIZE_BUCKETS * RESIZE_BUCKETS; i++)
+		{
+			if (resizes[i])
+				__atomic_fetch_add(&shared[i], resizes[i], __ATOMIC_RELAXED);
+			resizes[i] = 0;
+		}
+		local_resized = 0;
+	}
+}
+
+/*
+ * Lifetime sampling.  One allocation in LIFETIME_SAMPLE is followed: it goes
+ * into an open-addressed table keyed by address, with the call count at
+ * which it was allocated.  (Sampling by address would be cheaper still, but
+ * allocators hand the same few addresses out over and over.)  free() looks
+ * at the block's home slot without the lock first; only when that is taken
+ * can the block be in the table, so most frees never take the lock.
+ *
+ * The call count is this thread's plus what the other threads have
+ * published, which is exact for a single thread and within PUBLISH_INTERVAL
+ * calls per thread otherwise.
+ */
+#define LIFETIME_TABLE 65536
+
+typedef struct _lifetime_entry_t
+{
+	void *ptr;
+	unsigned long long birth;
+	int size_bucket;
+} lifetime_entry_t;
+
+static lifetime_entry_t lifetime_table[LIFETIME_TABLE];
+static int lifetime_entries = 0;
+static volatile char lifetime_lock = 0;
+static TLS unsigned long local_births = 0;
+
+static int lifetime_slot(void *ptr)
+{
+	return ((uintptr_t)ptr * 0x9E3779B97F4A7C15ULL >> 32) & (LIFETIME_TABLE - 1);
+}
+
+/* Slots are read without the lock, so every store to ptr is atomic. */
+static void lifetime_set(int i, void *ptr)
+{
+	__atomic_store_n(&lifetime_table[i].ptr, ptr, __ATOMIC_RELAXED);
+}
+
+static unsigned long long lifetime_clock()
+{
+	int i;
+	unsigned long long calls = 0;
+
+	for (i = 0; i < OP_TYPES; i++)
+		calls += __atomic_load_n(&stats->op_counts[i], __ATOMIC_RELAXED) + local_op_counts[i];
+
+	return calls;
+}
+
+static void lifetime_lock_table()
+{
+	while (__atomic_test_and_set(&lifetime_lock, __ATOMIC_ACQUIRE))
+		;
+}
+
+static void lifetime_unlock_table()
+{
+	__atomic_clear(&lifetime_lock, __ATOMIC_RELEASE);
+}
+
+/* Only the program's own calls are followed, as for the call counts. */
+static void contest_born(void *ptr, size_t size)
+{
+	if (!ptr || local_depth != 1 || local_births++ % LIFETIME_SAMPLE != 0)
+		return;
+
+	int i = lifetime_slot(ptr);
+	unsigned long long birth = lifetime_clock();
+
+	lifetime_lock_table();
+	if (lifetime_entries >= LIFETIME_TABLE * 3 / 4)
+	{
+		lifetime_unlock_table();
+		__atomic_fetch_add(&stats->lifetime_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	/* A block can only be here already if its free() went unseen. */
+	while (lifetime_table[i].ptr && lifetime_table[i].ptr != ptr)
+		i = (i + 1) & (LIFETIME_TABLE - 1);
+
+	if (!lifetime_table[i].ptr)
+		lifetime_entries++;
+	lifetime_table[i].birth = birth;
+	lifetime_table[i].size_bucket = log2_bucket(size, LIFETIME_SIZE_BUCKETS);
+	lifetime_set(i, ptr);
+	lifetime_unlock_table();
+}
+
+/*
+ * Called before the block is freed, so its address cannot be handed out and
+ * followed again before it is taken out of the table.
+ */
+static void contest_died(void *ptr)
+{
+	if (!ptr || local_depth != 1)
+		return;
+
+	/*
+	 * With linear probing a block is only ever in the run starting at its
+	 * home slot, and deleting never empties a slot in the middle of a run,
+	 * so an empty home slot means the block was not sampled.
+	 */
+	int i = lifetime_slot(ptr);
+	if (!__atomic_load_n(&lifetime_table[i].ptr, __ATOMIC_RELAXED))
+		return;
+
+	unsigned long long death = lifetime_clock();
+
+	lifetime_lock_table();
+	while (lifetime_table[i].ptr && lifetime_table[i].ptr != ptr)
+		i = (i + 1) & (LIFETIME_TABLE - 1);
+
+	if (!lifetime_table[i].ptr)
+	{
+		lifetime_unlock_table();
+		return;
+	}
+
+	unsigned long long birth = lifetime_table[i].birth;
+	int size_bucket = lifetime_table[i].size_bucket;
+
+	/*
+	 * Linear probing has no tombstones: move later entries of the run back
+	 * into the hole if it is at or past their own slot.
+	 */
+	int j = i;
+	for (;;)
+	{
+		j = (j + 1) & (LIFETIME_TABLE - 1);
+		if (!lifetime_table[j].ptr)
+			break;
+
+		int home = lifetime_slot(lifetime_table[j].ptr);
+		if (((j - home) & (LIFETIME_TABLE - 1)) >= ((j - i) & (LIFETIME_TABLE - 1)))
+		{
+			lifetime_table[i].birth = lifetime_table[j].birth;
+			lifetime_table[i].size_bucket = lifetime_table[j].size_bucket;
+			lifetime_set(i, lifetime_table[j].ptr);
+			i = j;
+		}
+	}
+	lifetime_set(i, NULL);
+	lifetime_entries--;
+	lifetime_unlock_table();
+
+	int lifetime = log2_bucket(death > birth ? death - birth : 0, LIFETIME_BUCKETS);
+	__atomic_fetch_add(&stats->lifetime_histogram[size_bucket][lifetime], 1, __ATOMIC_RELAXED);
+}
+
+/* The allocator's own realloc() counts, added up at exit. */
+static void contest_allocator_stats()
+{
+	unsigned long grown, shrunk, moved;
+	unsigned long long copied;
+
+	if (!alloc_realloc_stats)
+		return;
+
+	alloc_realloc_stats(&grown, &shrunk, &moved, &copied);
+	__atomic_fetch_add(&stats->alloc_realloc_outcomes[REALLOC_GROWN], grown, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->alloc_realloc_outcomes[REALLOC_SHRUNK], shrunk, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->alloc_realloc_outcomes[REALLOC_MOVED], moved, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->alloc_realloc_copied, copied, __ATOMIC_RELAXED);
+	stats->alloc_realloc_reported = 1;
+}
+
+/* At exit, whatever is still in the table was never freed. */
+static void contest_unfreed()
+{
+	int i;
+
+	lifetime_lock_table();
+	for (i = 0; i < LIFETIME_TABLE; i++)
+		if (lifetime_table[i].ptr)
+			__atomic_fetch_add(&stats->lifetime_unfreed[lifetime_table[i].size_bucket], 1, __ATOMIC_RELAXED);
+	lifetime_unlock_table();
+}
+
+/*
+ * Calls made after this (from other destructors, or from libc tearing the
+ * thread down) register the thread again, and glibc runs this again for
+ * them.
+ */
+static void contest_thread_exit(void *unused)
+{
+	contest_publish();
+	local_registered = 0;
+}
+
+__attribute__((destructor)) static void contest_exit()
+{
+	if (stats)
+	{
+		contest_unfreed();
+		contest_allocator_stats();
+		contest_publish();
+	}
+}
+
+/* Bytes between the break at startup and now, plus what the allocator has mapped. */
+static unsigned long long heap_extent()
+{
+	void *top = heap_top;
+	unsigned long long extent = (top > sbrk_init_done) ? (char *)top - (char *)sbrk_init_done : 0;
+	long long mapped = __atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED);
+
+	return extent + (mapped > 0 ? mapped : 0);
+}
+
+static void heap_changed()
+{
+	if (!stats)
+		return;
+
+	unsigned long long current_mem_usage = heap_extent();
+	unsigned long long max = __atomic_load_n(&stats->max_heap_used, __ATOMIC_RELAXED);
+
+	stats->current_heap = current_mem_usage;
+
+	while (max < current_mem_usage)
+	{
+		if (__atomic_compare_exchange_n(&stats->max_heap_used, &max, current_mem_usage, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+			sbrk_largest = heap_top;
+			break;
+		}
+	}
+
+	if (stats->max_heap_limit && current_mem_usage > stats->max_heap_limit)
+		heap_limit_exceeded = 1;
+}
+
+static void heap_moved(void *new_top)
+{
+	heap_top = new_top;
+	heap_changed();
+}
+
+void *sbrk(intptr_t increment)
+{
+	void *old_break = __sbrk(increment);
+	if (old_break != (void *)-1 && increment != 0)
+		heap_moved((char *)old_break + increment);
+
+	return old_break;
+}
+
+int brk(void *addr)
+{
+	void *current = __sbrk(0);
+	if (__sbrk((char *)addr - (char *)current) == (void *)-1)
+		return -1;
+
+	heap_moved(addr);
+	return 0;
+}
+
+/*
+ * Allocators that take memory from mmap() rather than sbrk() are measured
+ * by the anonymous mappings they make.  Only calls made while the allocator
+ * is running (local_depth > 0) count, so the program's own mappings, and
+ * the shim's, are not taken for heap.  munmap() and mremap() inside the
+ * allocator are assumed to be of its own anonymous memory.
+ */
+static size_t page_round(size_t length)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (length + page - 1) / page * page;
+}
+
+static void mapped_changed(long long delta)
+{
+	__atomic_add_fetch(&mapped_bytes, delta, __ATOMIC_RELAXED);
+	heap_changed();
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	void *ptr = __mmap(addr, length, prot, flags, fd, offset);
+	if (ptr != MAP_FAILED && local_depth > 0 && (flags & MAP_ANONYMOUS))
+		mapped_changed(page_round(length));
+
+	return ptr;
+}
+
+void *mmap64(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	return mmap(addr, length, prot, flags, fd, offset);
+}
+
+int munmap(void *addr, size_t length)
+{
+	int result = __munmap(addr, length);
+	if (result == 0 && local_depth > 0)
+		mapped_changed(-(long long)page_round(length));
+
+	return result;
+}
+
+void *mremap(void *old_address, size_t old_size, size_t new_size, int flags, ...)
+{
+	void *new_address = NULL;
+	if (flags & MREMAP_FIXED)
+	{
+		va_list args;
+		va_start(args, flags);
+		new_address = va_arg(args, void *);
+		va_end(args);
+	}
+
+	void *ptr = (void *)syscall(SYS_mremap, old_address, old_size, new_size, flags, new_address);
+	if (ptr != MAP_FAILED && local_depth > 0)
+		mapped_changed((long long)page_round(new_size) - (long long)page_round(old_size));
+
+	return ptr;
+}
+
+/*
+ * One call in every LATENCY_SAMPLE is timed for the latency histogram.  The
+ * clock is read only for those, so the rest pay a single test.
+ */
+#define LATENCY_SAMPLE 64
+
+static unsigned long long contest_clock()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static unsigned long long contest_start()
+{
+	return (local_depth++ == 0 && local_uses % LATENCY_SAMPLE == 0) ? contest_clock() : 0;
+}
+
+/* Usable size of an alloc.so block, for the live byte count. */
+static long long contest_size(void *ptr)
+{
+	return (ptr && alloc_malloc_usable_size) ? (long long)alloc_malloc_usable_size(ptr) : 0;
+}
+
+/*
+ * Called at the end of every call, with the size requested (ignored for
+ * free()) and the change in live bytes.
+ */
+static void contest_tracking(int op, unsigned long long start, size_t size, long long live_delta)
+{
+	local_heap_sum += heap_extent();
+
+	if (--local_depth == 0)
+	{
+		local_live_bytes += live_delta;
+		local_op_counts[op]++;
+		if (op != OP_FREE)
+			local_sizes[size_bucket(size)]++;
+	}
+
+	if (start)
+	{
+		unsigned long long elapsed = contest_clock() - start;
+		int bucket = elapsed ? 63 - __builtin_clzll(elapsed) : 0;
+		local_latency[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+	}
+
+	/* Have contest_thread_exit() called when this thread ends. */
+	if (__builtin_expect(!local_registered, 0))
+	{
+		local_registered = 1;
+		pthread_setspecific(publish_key, (void *)1);
+	}
+
+	if (++local_uses >= PUBLISH_INTERVAL)
+		contest_publish();
+
+	if (heap_limit_exceeded)
+	{
+		contest_publish();
+		fprintf(stderr, "Exceeded the %llu byte heap limit\n", stats->max_heap_limit);
+		exit(68);
+	}
+}
+
 static void contest_alloc_init()
 {
 	inside_init = 1;
 	
-	/* Tell malloc() not to use mmap() */
-	mallopt(M_MMAP_MAX, 0);
+	/* mcontest -a selects a different allocator to measure. */
+	char *alloc_path = getenv("ALLOC_CONTEST_LIB");
+	if (!alloc_path)
+		alloc_path = "./alloc.so";
+
+	/*
+	 * Tell malloc() not to use mmap(), except when libc is the allocator being
+	 * measured, which has to behave exactly as it does without the shim.
+	 */
+	if (strcmp(alloc_path, "libc") != 0)
+		mallopt(M_MMAP_MAX, 0);
 	
 	sbrk_start = sbrk_largest = sbrk(0);
 	
@@ -51,15 +556,25 @@ static void contest_alloc_init()
 	libc_malloc  = dlsym(RTLD_NEXT, "malloc");
 	libc_free    = dlsym(RTLD_NEXT, "free");
 	libc_realloc = dlsym(RTLD_NEXT, "realloc");
+	libc_memalign = dlsym(RTLD_NEXT, "memalign");
+	libc_malloc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
 	
 	inside_init = 2;
-	
-	alloc_handle = dlopen("./alloc.so", RTLD_NOW | RTLD_GLOBAL);
+
+	/*
+	 * "libc" is the null allocator used by mcontest -n: every call passes
+	 * straight through to libc, so the time measured is the shim's own.
+	 */
+	if (strcmp(alloc_path, "libc") == 0)
+		alloc_handle = RTLD_NEXT;
+	else
+		alloc_handle = dlopen(alloc_path, RTLD_NOW | RTLD_GLOBAL);
+
 	if (!alloc_handle)
 	{
 		char *err =  dlerror();
 
-		if (!err)
+		if (err)
 			fprintf(stderr, "A dynamic linking error occurred: (%s)\n", err);
 		else
 			fprintf(stderr, "An unknown dynamic linking error occurred.\n");
@@ -77,44 +592,52 @@ static void contest_alloc_init()
 		fprintf(stderr, "Unable to dynamicly load a required memory allocation call.\n");
 		exit(66);
 	}
+
+	alloc_memalign           = dlsym(alloc_handle, "memalign");
+	alloc_aligned_alloc      = dlsym(alloc_handle, "aligned_alloc");
+	alloc_posix_memalign     = dlsym(alloc_handle, "posix_memalign");
+	alloc_malloc_usable_size = dlsym(alloc_handle, "malloc_usable_size");
+	alloc_owns               = dlsym(alloc_handle, "alloc_owns");
+	alloc_requested_size     = dlsym(alloc_handle, "alloc_requested_size");
+	alloc_realloc_stats      = dlsym(alloc_handle, "alloc_realloc_stats");
 	
 	char *file_name = getenv("ALLOC_CONTEST_MMAP");
 	int fd = open(file_name, O_RDWR);
-	stats = mmap(NULL, sizeof(alloc_stats_t), PROT_WRITE, MAP_SHARED, fd, 0);
+	stats = mmap(NULL, sizeof(alloc_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 
 	if (fd <= 0 || stats == (void *)-1)
 	{
 		fprintf(stderr, "fd/mmap");
 		exit(67);
 	}
-	
-	stats->max_heap_used = 0;
-	stats->memory_heap_sum = 0;
-	stats->memory_uses = 0;
-	
-	sbrk_init_done = sbrk(0);
+
+	/*
+	 * The counters are cleared by mcontest, not here, since child processes
+	 * of the program load this shim too and add to the same stats.
+	 */
+	pthread_key_create(&publish_key, contest_thread_exit);
+
+	/* The first process to start is the one mtop follows. */
+	int no_pid = 0;
+	__atomic_compare_exchange_n(&stats->pid, &no_pid, getpid(), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	stats->live_tracked = (alloc_malloc_usable_size != NULL);
+
+	sbrk_init_done = heap_top = sbrk(0);
 	inside_init = 0;
 }
 
-static void contest_tracking()
+/*
+ * Blocks libc handed out before the shim was set up must go back to libc.
+ * alloc_owns() from alloc.so answers that exactly; without it, anything
+ * below the break at the end of setup is assumed to be libc's, which breaks
+ * as soon as an allocator places memory anywhere else.
+ */
+static int contest_owns(void *ptr)
 {
-	void *sbrk_current = sbrk(0);
-	unsigned long current_mem_usage = ((long)sbrk_current - (long)sbrk_init_done);
-	
-	if (stats->max_heap_used < current_mem_usage)
-	{
-		sbrk_largest = sbrk_current;
-		stats->max_heap_used = current_mem_usage;
+	if (alloc_owns)
+		return alloc_owns(ptr);
 
-		if (current_mem_usage > (1024L * 1024L * 1024L * 2L))
-		{
-			fprintf(stderr, "Exceeded 2 GB\n");
-			exit(68);
-		}
-	}
-	
-	stats->memory_heap_sum += current_mem_usage;
-	stats->memory_uses++;
+	return ptr >= sbrk_init_done;
 }
 
 void *calloc(size_t nmemb, size_t size)
@@ -134,8 +657,10 @@ void *calloc(size_t nmemb, size_t size)
 	if (!alloc_handle)
 		contest_alloc_init();
 
+	unsigned long long start = contest_start();
 	void *addr = alloc_calloc(nmemb, size);
-	contest_tracking();
+	contest_born(addr, nmemb * size);
+	contest_tracking(OP_CALLOC, start, nmemb * size, contest_size(addr));
 
 	return addr;
 }
@@ -148,8 +673,10 @@ void *malloc(size_t size)
 	if (!alloc_handle)
 		contest_alloc_init();
 
+	unsigned long long start = contest_start();
 	void *addr = alloc_malloc(size);
-	contest_tracking();
+	contest_born(addr, size);
+	contest_tracking(OP_MALLOC, start, size, contest_size(addr));
 
 	return addr;
 }
@@ -165,17 +692,82 @@ void free(void *ptr)
 	if (!alloc_handle)
 		contest_alloc_init();
 	
-	if (ptr < sbrk_init_done)
+	if (!ptr)
+		return;
+
+	if (!contest_owns(ptr))
 	{
 		libc_free(ptr);
 		return;
 	}
 
-	if (ptr)
+	long long old_size = contest_size(ptr);
+	unsigned long long start = contest_start();
+	contest_died(ptr);
+	alloc_free(ptr);
+	contest_tracking(OP_FREE, start, 0, -old_size);
+}
+
+/*
+ * The usable size of a block passed to realloc(), or 0 if the allocator
+ * does not say.
+ */
+static size_t contest_old_size(void *ptr)
+{
+	if (!ptr)
+		return 0;
+
+	return contest_owns(ptr) ? (size_t)contest_size(ptr) : libc_malloc_usable_size(ptr);
+}
+
+/*
+ * Counts a realloc() of an existing block by its old and new size.  Only the
+ * program's own calls are counted, and only when the old size is known.
+ */
+static void contest_resize(void *ptr, size_t old_size, size_t size)
+{
+	if (!ptr || local_depth != 1 || !alloc_malloc_usable_size)
+		return;
+
+	local_resizes[resize_bucket(old_size)][resize_bucket(size)]++;
+	local_resized = 1;
+}
+
+/*
+ * The size a block passed to realloc() was last asked for, when alloc.so
+ * provides alloc_requested_size(); otherwise its usable size stands in.
+ */
+static size_t contest_requested_size(void *ptr, size_t usable_size)
+{
+	if (ptr && alloc_requested_size && contest_owns(ptr))
+		return alloc_requested_size(ptr);
+
+	return usable_size;
+}
+
+/*
+ * Counts what a realloc() of an existing block did: kept it where it was,
+ * grown or shrunk from the size it was last asked for, or moved it, which
+ * copies at most the smaller of the old and new sizes.  A realloc() to the
+ * same size is not counted, as in alloc.so.  When only the usable size is
+ * known, a block kept in place counts as shrunk whenever the new size fits.
+ */
+static void contest_reallocated(void *ptr, void *addr, size_t old_size, size_t size)
+{
+	if (!ptr || !addr || local_depth != 1)
+		return;
+
+	if (addr == ptr && size == old_size)
+		return;
+
+	if (addr == ptr)
+		local_realloc_outcomes[size > old_size ? REALLOC_GROWN : REALLOC_SHRUNK]++;
+	else
 	{
-		alloc_free(ptr);
-		contest_tracking();
+		local_realloc_outcomes[REALLOC_MOVED]++;
+		local_realloc_copied += old_size < size ? old_size : size;
 	}
+	local_resized = 1;
 }
 
 void *realloc(void *ptr, size_t size)
@@ -187,17 +779,209 @@ void *realloc(void *ptr, size_t size)
 		contest_alloc_init();
 
 	void *addr;
+	long long old_size = 0;
+	unsigned long long start = contest_start();
+	size_t old_usable = contest_old_size(ptr);
+	size_t old_requested = contest_requested_size(ptr, old_usable);
+	contest_resize(ptr, old_usable, size);
 	if (!ptr)
 		addr = alloc_malloc(size);
+	else if (!contest_owns(ptr))
+	{
+		/* Move the block over to alloc.so rather than growing libc's heap. */
+		size_t libc_size = libc_malloc_usable_size(ptr);
+		addr = size ? alloc_malloc(size) : NULL;
+		if (addr)
+			memcpy(addr, ptr, libc_size < size ? libc_size : size);
+		if (addr || !size)
+			libc_free(ptr);
+	}
 	else if (size == 0)
 	{	
+		old_size = contest_size(ptr);
+		contest_died(ptr);
 		alloc_free(ptr);
 		addr = NULL;
 	}
 	else
+	{
+		old_size = contest_size(ptr);
 		addr = alloc_realloc(ptr, size);
-	contest_tracking();
+		if (!addr)
+			old_size = 0;
+	}
+
+	/*
+	 * A block that moves dies and is born again at its new address; one
+	 * grown or shrunk in place lives on.  (The old block is already free
+	 * here, but another thread getting the same address in the meantime
+	 * and having it sampled is rare enough not to matter.)
+	 */
+	if (addr && addr != ptr)
+	{
+		contest_died(ptr);
+		contest_born(addr, size);
+	}
+	contest_reallocated(ptr, addr, old_requested, size);
+	contest_tracking(OP_REALLOC, start, size, contest_size(addr) - old_size);
+
+	return addr;
+}
+
+
+/*
+ * Every aligned allocation call goes to whichever aligned call alloc.so
+ * provides.  Without one there is no way to satisfy the request from
+ * alloc.so's heap, and handing it to libc would mix the heaps.
+ */
+static void *contest_memalign(size_t alignment, size_t size)
+{
+	void *addr = NULL;
+	unsigned long long start = contest_start();
 
+	if (alloc_memalign)
+		addr = alloc_memalign(alignment, size);
+	else if (alloc_aligned_alloc)
+		addr = alloc_aligned_alloc(alignment, size);
+	else if (alloc_posix_memalign)
+	{
+		if (alloc_posix_memalign(&addr, alignment < sizeof(void *) ? sizeof(void *) : alignment, size) != 0)
+			addr = NULL;
+	}
+	else
+	{
+		fprintf(stderr, "The allocator does not provide memalign(), aligned_alloc() or posix_memalign().\n");
+		exit(66);
+	}
+
+	contest_born(addr, size);
+	contest_tracking(OP_MEMALIGN, start, size, contest_size(addr));
 	return addr;
 }
 
+void *memalign(size_t alignment, size_t size)
+{
+	if (inside_init)
+		return libc_memalign(alignment, size);
+	
+	if (!alloc_handle)
+		contest_alloc_init();
+
+	return contest_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	if (alignment == 0 || alignment % sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+
+	void *addr = memalign(alignment, size);
+	if (!addr)
+		return ENOMEM;
+
+	*memptr = addr;
+	return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+	return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	if (size > (size_t)-1 - page_size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	return memalign(page_size, (size + page_size - 1) / page_size * page_size);
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+	if (size && nmemb > (size_t)-1 / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return realloc(ptr, nmemb * size);
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+	if (inside_init)
+		return libc_malloc_usable_size(ptr);
+	
+	if (!alloc_handle)
+		contest_alloc_init();
+
+	if (ptr && !contest_owns(ptr))
+		return libc_malloc_usable_size(ptr);
+
+	/*
+	 * Without alloc.so's own malloc_usable_size() the shim has no record of
+	 * a block's size, so it returns 0 even for a live block.  A caller that
+	 * trusts this will use less of the block than it could, never more.
+	 */
+	return (ptr && alloc_malloc_usable_size) ? alloc_malloc_usable_size(ptr) : 0;
+}
+
+
+/*
+ * C++ operator new and delete.  libstdc++'s own versions would end up here
+ * through malloc() anyway, but the aligned forms would not, and defining all
+ * of them keeps every C++ allocation on alloc.so's heap and in the stats.
+ * Being C, these cannot throw std::bad_alloc: on failure they call the
+ * program's new_handler, if any, and otherwise abort().
+ */
+static void *cxx_new(size_t size, size_t alignment, int nothrow)
+{
+	if (size == 0)
+		size = 1;
+
+	for (;;)
+	{
+		void *addr = alignment ? memalign(alignment, size) : malloc(size);
+		if (addr || nothrow)
+			return addr;
+
+		void (*(*get_new_handler)(void))(void) = dlsym(RTLD_DEFAULT, "_ZSt15get_new_handlerv");
+		void (*handler)(void) = get_new_handler ? get_new_handler() : NULL;
+		if (!handler)
+		{
+			fprintf(stderr, "operator new: out of memory allocating %zu bytes\n", size);
+			abort();
+		}
+		handler();
+	}
+}
+
+void *_Znwm(size_t size) { return cxx_new(size, 0, 0); }
+void *_Znam(size_t size) { return cxx_new(size, 0, 0); }
+void *_ZnwmRKSt9nothrow_t(size_t size, const void *tag) { return cxx_new(size, 0, 1); }
+void *_ZnamRKSt9nothrow_t(size_t size, const void *tag) { return cxx_new(size, 0, 1); }
+void *_ZnwmSt11align_val_t(size_t size, size_t alignment) { return cxx_new(size, alignment, 0); }
+void *_ZnamSt11align_val_t(size_t size, size_t alignment) { return cxx_new(size, alignment, 0); }
+void *_ZnwmSt11align_val_tRKSt9nothrow_t(size_t size, size_t alignment, const void *tag) { return cxx_new(size, alignment, 1); }
+void *_ZnamSt11align_val_tRKSt9nothrow_t(size_t size, size_t alignment, const void *tag) { return cxx_new(size, alignment, 1); }
+
+void _ZdlPv(void *ptr) { free(ptr); }
+void _ZdaPv(void *ptr) { free(ptr); }
+void _ZdlPvm(void *ptr, size_t size) { free(ptr); }
+void _ZdaPvm(void *ptr, size_t size) { free(ptr); }
+void _ZdlPvRKSt9nothrow_t(void *ptr, const void *tag) { free(ptr); }
+void _ZdaPvRKSt9nothrow_t(void *ptr, const void *tag) { free(ptr); }
+void _ZdlPvSt11align_val_t(void *ptr, size_t alignment) { free(ptr); }
+void _ZdaPvSt11align_val_t(void *ptr, size_t alignment) { free(ptr); }
+void _ZdlPvmSt11align_val_t(void *ptr, size_t size, size_t alignment) { free(ptr); }
+void _ZdaPvmSt11align_val_t(void *ptr, size_t size, size_t alignment) { free(ptr); }
+void _ZdlPvSt11align_val_tRKSt9nothrow_t(void *ptr, size_t alignment, const void *tag) { free(ptr); }
+void _ZdaPvSt11align_val_tRKSt9nothrow_t(void *ptr, size_t alignment, const void *tag) { free(ptr); }
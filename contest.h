@@ -6,12 +6,179 @@
 #ifndef _CONTEST_H_
 #define _CONTEST_H_
 
+/* The kinds of call counted in op_counts. */
+enum { OP_MALLOC, OP_CALLOC, OP_REALLOC, OP_FREE, OP_MEMALIGN, OP_TYPES };
+
+/*
+ * What realloc() of an existing block did.  Grown and shrunk are for blocks
+ * resized in place.
+ */
+enum { REALLOC_GROWN, REALLOC_SHRUNK, REALLOC_MOVED, REALLOC_OUTCOMES };
+
+/*
+ * The shim publishes each thread's counters to the shared stats every
+ * PUBLISH_INTERVAL calls and when the thread or process exits, so a program
+ * that is killed loses up to this many calls per thread.
+ */
+#define PUBLISH_INTERVAL 4096
+
+/* Latency bucket i holds sampled calls that took [2^i, 2^(i+1)) ns. */
+#define LATENCY_BUCKETS 32
+
+/*
+ * Request sizes are counted in 16 byte steps up to 128 bytes, where most
+ * requests are and where allocators keep exact size classes, and in four
+ * steps per power of two above that.  The last bucket takes everything from
+ * 1 TB up.
+ */
+#define SIZE_LINEAR_STEP 16
+#define SIZE_LINEAR_MAX 128
+#define SIZE_LINEAR_BUCKETS (SIZE_LINEAR_MAX / SIZE_LINEAR_STEP)
+#define SIZE_BUCKETS (SIZE_LINEAR_BUCKETS + 4 * (40 - 7) + 1)
+
+static inline int size_bucket(unsigned long long size)
+{
+	if (size <= SIZE_LINEAR_MAX)
+		return size ? (size - 1) / SIZE_LINEAR_STEP : 0;
+
+	int power = 63 - __builtin_clzll(size - 1);
+	int bucket = SIZE_LINEAR_BUCKETS + (power - 7) * 4 + (((size - 1) >> (power - 2)) & 3);
+	return bucket < SIZE_BUCKETS ? bucket : SIZE_BUCKETS - 1;
+}
+
+/* The largest size counted in a bucket. */
+static inline unsigned long long size_bucket_limit(int bucket)
+{
+	if (bucket < SIZE_LINEAR_BUCKETS)
+		return (bucket + 1) * SIZE_LINEAR_STEP;
+
+	int power = 7 + (bucket - SIZE_LINEAR_BUCKETS) / 4;
+	return (1ULL << power) + ((bucket - SIZE_LINEAR_BUCKETS) % 4 + 1) * (1ULL << (power - 2));
+}
+
+/*
+ * Power of two buckets: bucket i holds values of [2^(i-1), 2^i), bucket 0
+ * holds 0, and the last holds everything bigger.
+ */
+static inline int log2_bucket(unsigned long long value, int buckets)
+{
+	int bucket = value ? 64 - __builtin_clzll(value) : 0;
+	return bucket < buckets ? bucket : buckets - 1;
+}
+
+/*
+ * Returns the bucket of a histogram holding the given fraction of its
+ * counts, or -1 if it is empty.
+ */
+static inline int percentile_bucket(unsigned long *histogram, int buckets, double fraction)
+{
+	int i;
+	unsigned long total = 0, seen = 0;
+
+	for (i = 0; i < buckets; i++)
+		total += histogram[i];
+	if (total == 0)
+		return -1;
+
+	for (i = 0; i < buckets - 1; i++)
+	{
+		seen += histogram[i];
+		if (seen >= fraction * total)
+			break;
+	}
+
+	return i;
+}
+
+/* The upper bound, in ns, of a latency percentile, or 0 without samples. */
+static inline unsigned long long latency_percentile(unsigned long *histogram, double fraction)
+{
+	int bucket = percentile_bucket(histogram, LATENCY_BUCKETS, fraction);
+	return bucket < 0 ? 0 : 2ULL << bucket;
+}
+
+/*
+ * realloc() is counted by old and new size, in power of two buckets; the
+ * last holds 1 GB and up.
+ */
+#define RESIZE_BUCKETS 32
+
+static inline int resize_bucket(unsigned long long size)
+{
+	return log2_bucket(size, RESIZE_BUCKETS);
+}
+
+/*
+ * Lifetimes are counted for a sample of blocks (1 in LIFETIME_SAMPLE), by
+ * the size requested and by the number of calls the program made between
+ * allocating and freeing the block, both in power of two buckets.
+ */
+#define LIFETIME_SAMPLE 64
+#define LIFETIME_SIZE_BUCKETS 32
+#define LIFETIME_BUCKETS 40
+
 typedef struct _alloc_stats_t
 {
 	unsigned long long max_heap_used;
 	
 	unsigned long memory_uses;
 	unsigned long long memory_heap_sum;
+
+	/* Set by mcontest: the program is stopped once its heap grows past this. */
+	unsigned long long max_heap_limit;
+
+	/*
+	 * Set by mcontest to its own pid.  pid below is whichever measured
+	 * process first loaded the shim since the last reset, so with warm-up
+	 * runs or -f it comes and goes; the stats stay live while owner_pid runs.
+	 */
+	int owner_pid;
+
+	/*
+	 * Live view, for mtop.  The shim publishes these as it runs, not only at
+	 * exit.  live_bytes is only kept when the allocator provides
+	 * malloc_usable_size(); live_tracked says whether it does.
+	 */
+	int pid;
+	int live_tracked;
+	unsigned long long current_heap;
+	long long live_bytes;
+	unsigned long op_counts[OP_TYPES];
+	unsigned long latency_histogram[LATENCY_BUCKETS];
+
+	/*
+	 * Allocation profile: the size of every malloc(), calloc(), realloc() and
+	 * aligned allocation, and the old and new size of every realloc() of an
+	 * existing block (the old size is the usable size of the block, so this
+	 * is only kept when live_tracked is set).
+	 */
+	unsigned long size_histogram[SIZE_BUCKETS];
+	unsigned long resize_histogram[RESIZE_BUCKETS][RESIZE_BUCKETS];
+
+	/*
+	 * Sampled lifetimes by size.  Blocks still allocated at exit are counted
+	 * in unfreed instead; dropped counts the samples there was no room to
+	 * follow.
+	 */
+	unsigned long lifetime_histogram[LIFETIME_SIZE_BUCKETS][LIFETIME_BUCKETS];
+	unsigned long lifetime_unfreed[LIFETIME_SIZE_BUCKETS];
+	unsigned long lifetime_dropped;
+
+	/*
+	 * realloc() outcomes as the shim sees them, by comparing the pointer
+	 * returned with the one passed in and the new size with the size the
+	 * block was last asked for.  That size comes from the allocator's
+	 * alloc_requested_size(); without it the usable size stands in, so
+	 * shrunk then means the new size fit in the block, and the bytes copied
+	 * are an upper bound.  A realloc() to the same size is not counted.
+	 * When the allocator provides alloc_realloc_stats(), its own exact counts
+	 * are kept too, and alloc_realloc_reported is set.
+	 */
+	unsigned long realloc_outcomes[REALLOC_OUTCOMES];
+	unsigned long long realloc_copied;
+	int alloc_realloc_reported;
+	unsigned long alloc_realloc_outcomes[REALLOC_OUTCOMES];
+	unsigned long long alloc_realloc_copied;
 } alloc_stats_t;
 
 #endif
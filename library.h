@@ -0,0 +1,40 @@
+/*
+ * CS 241
+ * The University of Illinois
+ */
+
+#ifndef _LIBRARY_H_
+#define _LIBRARY_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+/*
+ * Returns the absolute path of a library that ships with the tools (alloc.so,
+ * contest-alloc.so), looking first in the current directory and then next to
+ * the running binary, so the tools work from any directory.  The result must
+ * be freed.
+ */
+static inline char *find_library(const char *name)
+{
+	char path[PATH_MAX];
+	char *resolved = realpath(name, NULL);
+	if (resolved)
+		return resolved;
+
+	ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (length < 0)
+		return NULL;
+	path[length] = '\0';
+
+	char *slash = strrchr(path, '/');
+	if (!slash || (size_t)(slash - path) + 1 + strlen(name) >= sizeof(path))
+		return NULL;
+	strcpy(slash + 1, name);
+
+	return realpath(path, NULL);
+}
+
+#endif
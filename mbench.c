@@ -0,0 +1,816 @@
+/*
+ * CS 241
+ * The University of Illinois
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+
+#define MAX_TESTERS 64
+#define MAX_ALLOCATORS 8
+#define MAX_RESULTS (MAX_TESTERS * MAX_ALLOCATORS)
+#define MAX_REPS 100
+#define MAX_JOBS 256
+#define LINE_LENGTH 16384
+
+/*
+ * Each metric is read from one "[mcontest]: LABEL: value" line of mcontest's
+ * output and is stored in the JSON results under its json name.  Metrics with
+ * a gate are checked for regressions in compare mode.
+ */
+enum { GATE_NONE, GATE_TIME, GATE_MEMORY };
+
+typedef struct _metric_t
+{
+	const char *label;
+	const char *json;
+	int gate;
+} metric_t;
+
+static const metric_t metrics[] =
+{
+	{ "TIME", "time",     GATE_TIME },
+	{ "MAX",  "max_heap", GATE_MEMORY },
+	{ "AVG",  "avg_heap", GATE_MEMORY },
+	{ "ADJUSTED_TIME", "adjusted_time", GATE_NONE },
+	{ "WALL",   "wall",     GATE_NONE },
+	{ "MINFLT", "minflt",   GATE_NONE },
+	{ "MAXRSS", "maxrss",   GATE_NONE },
+	{ "CYCLES",       "cycles",       GATE_NONE },
+	{ "INSTRUCTIONS", "instructions", GATE_NONE },
+};
+
+#define NUM_METRICS (int)(sizeof(metrics) / sizeof(metrics[0]))
+
+typedef struct _summary_t
+{
+	int n;
+	double mean;
+	double sd;
+	double median;
+	double min;
+} summary_t;
+
+typedef struct _result_t
+{
+	char tester[256];
+	char allocator[256];
+	int failures;
+	summary_t summary[NUM_METRICS];
+} result_t;
+
+static const char *default_testers[] =
+{
+	"./tester-1", "./tester-2", "./tester-3", "./tester-4", "./tester-5", "./tester-9", NULL
+};
+
+static const char *mcontest_path = "./mcontest";
+
+/* Options passed through to every mcontest invocation. */
+#define MAX_OPTIONS 16
+static const char *mcontest_options[MAX_OPTIONS];
+static int num_options = 0;
+
+/* Adds an option and its value, if any.  Returns -1 if there is no room. */
+static int add_option(const char *option, const char *value)
+{
+	if (num_options + (value ? 2 : 1) > MAX_OPTIONS)
+		return -1;
+
+	mcontest_options[num_options++] = option;
+	if (value)
+		mcontest_options[num_options++] = value;
+	return 0;
+}
+
+/*
+ * The machine the results were measured on, as reported by mcontest.  A
+ * baseline from a different machine is still compared, but with a warning.
+ */
+static const char *environment_labels[] = { "CPU", "GOVERNOR", "KERNEL", NULL };
+static char environment[3][256];
+static char base_environment[3][256];
+
+
+/*
+ * Two-sided 95% critical values of Student's t distribution for 1..30 degrees
+ * of freedom.  Beyond 30 the normal approximation is close enough.
+ */
+static const double t_critical[] =
+{
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double critical_value(double df)
+{
+	int i = (int)df;
+
+	if (i < 1)
+		i = 1;
+	if (i > 30)
+		return 1.960;
+	return t_critical[i - 1];
+}
+
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void summarize(double *values, int n, summary_t *s)
+{
+	int i;
+	double sum = 0, sq = 0;
+
+	memset(s, 0, sizeof(summary_t));
+	s->n = n;
+	if (n == 0)
+		return;
+
+	for (i = 0; i < n; i++)
+		sum += values[i];
+	s->mean = sum / n;
+
+	for (i = 0; i < n; i++)
+		sq += (values[i] - s->mean) * (values[i] - s->mean);
+	s->sd = (n > 1) ? sqrt(sq / (n - 1)) : 0;
+
+	qsort(values, n, sizeof(double), compare_doubles);
+	s->min = values[0];
+	s->median = (n % 2) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+
+/*
+ * One (tester, allocator, rep) run of mcontest.  Runs of the same tester and
+ * allocator share a result.  The output goes to a temporary file rather than
+ * a pipe so that a chatty program cannot stall while other jobs are reaped.
+ */
+typedef struct _job_t
+{
+	pid_t pid;
+	int result;
+	int core;
+	FILE *output;
+} job_t;
+
+static void start_job(job_t *job, result_t *result)
+{
+	int i;
+
+	job->output = tmpfile();
+	if (!job->output)
+	{
+		perror("tmpfile()");
+		exit(4);
+	}
+
+	job->pid = fork();
+	if (job->pid == 0)   /* child */
+	{
+		const char *args[MAX_OPTIONS + 8];
+		char core[16];
+		int argc = 0;
+
+		dup2(fileno(job->output), STDOUT_FILENO);
+
+		args[argc++] = mcontest_path;
+		for (i = 0; i < num_options; i++)
+			args[argc++] = mcontest_options[i];
+		if (job->core >= 0)
+		{
+			snprintf(core, sizeof(core), "%d", job->core);
+			args[argc++] = "-c";
+			args[argc++] = core;
+		}
+		if (result->allocator[0])
+		{
+			args[argc++] = "-a";
+			args[argc++] = result->allocator;
+		}
+		args[argc++] = result->tester;
+		args[argc] = NULL;
+
+		execv(mcontest_path, (char **)args);
+		perror("exec() failed");
+		exit(3);
+	}
+	else if (job->pid < 0)
+	{
+		perror("fork()");
+		exit(4);
+	}
+}
+
+/*
+ * Reads a finished job's output and fills in one value per metric.  Returns
+ * zero if mcontest reported STATUS: OK and exited cleanly.
+ */
+static int finish_job(job_t *job, int status, double *values)
+{
+	int i, ok = 0;
+	char line[LINE_LENGTH];
+
+	for (i = 0; i < NUM_METRICS; i++)
+		values[i] = 0;
+
+	rewind(job->output);
+	while (fgets(line, sizeof(line), job->output))
+	{
+		if (strncmp(line, "[mcontest]: ", 12) != 0)
+			continue;
+
+		char *label = line + 12;
+		char *value = strstr(label, ": ");
+		if (!value)
+			continue;
+		*value = '\0';
+		value += 2;
+
+		if (strcmp(label, "STATUS") == 0)
+			ok = (strncmp(value, "OK", 2) == 0);
+
+		for (i = 0; i < NUM_METRICS; i++)
+			if (strcmp(label, metrics[i].label) == 0)
+				values[i] = atof(value);
+
+		for (i = 0; environment_labels[i]; i++)
+			if (strcmp(label, environment_labels[i]) == 0 && !environment[i][0])
+				snprintf(environment[i], sizeof(environment[i]), "%.*s", (int)strcspn(value, "\n"), value);
+	}
+	fclose(job->output);
+	job->pid = 0;
+
+	return !(ok && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/*
+ * Runs every (tester, allocator) result reps times, keeping up to num_jobs
+ * mcontest processes going at once.  With cores, each running job is pinned
+ * to its own core.  Reps are the outer loop so that slow drift in machine
+ * state is spread evenly over all results.
+ */
+static void run_all(result_t *results, int count, int reps, int num_jobs, int *cores)
+{
+	int i, j, next = 0, running = 0, total = count * reps;
+	double values[NUM_METRICS];
+	double *samples = malloc(count * NUM_METRICS * MAX_REPS * sizeof(double));
+	int *n = calloc(count, sizeof(int));
+	job_t *jobs = calloc(num_jobs, sizeof(job_t));
+
+	while (next < total || running > 0)
+	{
+		while (running < num_jobs && next < total)
+		{
+			for (i = 0; jobs[i].pid != 0; i++)
+				;
+			jobs[i].result = next % count;
+			jobs[i].core = cores ? cores[i] : -1;
+			start_job(&jobs[i], &results[jobs[i].result]);
+			next++;
+			running++;
+		}
+
+		int status;
+		pid_t pid = wait(&status);
+		if (pid < 0)
+		{
+			perror("wait()");
+			exit(4);
+		}
+
+		for (i = 0; i < num_jobs && jobs[i].pid != pid; i++)
+			;
+		if (i == num_jobs)
+			continue;
+		running--;
+
+		int r = jobs[i].result;
+		if (finish_job(&jobs[i], status, values) != 0)
+		{
+			results[r].failures++;
+			continue;
+		}
+
+		for (j = 0; j < NUM_METRICS; j++)
+			samples[(r * NUM_METRICS + j) * MAX_REPS + n[r]] = values[j];
+		n[r]++;
+	}
+
+	for (i = 0; i < count; i++)
+		for (j = 0; j < NUM_METRICS; j++)
+			summarize(&samples[(i * NUM_METRICS + j) * MAX_REPS], n[i], &results[i].summary[j]);
+
+	free(jobs);
+	free(n);
+	free(samples);
+}
+
+/*
+ * Parses a CPU list such as 0-3,6 (the syntax of taskset -c).  Returns the
+ * number of cores stored, or -1 if the list is invalid.
+ */
+static int parse_cores(const char *list, int *cores, int max)
+{
+	int count = 0;
+
+	while (*list)
+	{
+		char *end;
+		long first = strtol(list, &end, 10), last;
+		if (end == list || first < 0)
+			return -1;
+
+		last = first;
+		if (*end == '-')
+		{
+			list = end + 1;
+			last = strtol(list, &end, 10);
+			if (end == list || last < first)
+				return -1;
+		}
+
+		for (; first <= last && count < max; first++)
+			cores[count++] = first;
+
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		list = end;
+	}
+
+	return count;
+}
+
+
+static void result_name(result_t *result, char *name, size_t size)
+{
+	if (result->allocator[0])
+		snprintf(name, size, "%s [%s]", result->tester, result->allocator);
+	else
+		snprintf(name, size, "%s", result->tester);
+}
+
+
+/* Writes a string as a quoted JSON string, escaping what JSON requires. */
+static void write_json_string(FILE *file, const char *string)
+{
+	fputc('"', file);
+	for (; *string; string++)
+	{
+		unsigned char c = (unsigned char)*string;
+
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if (c == '\n')
+			fputs("\\n", file);
+		else if (c == '\t')
+			fputs("\\t", file);
+		else if (c < 0x20)
+			fprintf(file, "\\u%04x", c);
+		else
+			fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+static void write_json(FILE *file, result_t *results, int count, int reps)
+{
+	int i, j;
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"reps\": %d,\n", reps);
+	for (i = 0; environment_labels[i]; i++)
+	{
+		fprintf(file, "  \"%s\": ", environment_labels[i]);
+		write_json_string(file, environment[i]);
+		fprintf(file, ",\n");
+	}
+	fprintf(file, "  \"results\": [\n");
+
+	/* One result per line, which is what load_json() expects. */
+	for (i = 0; i < count; i++)
+	{
+		fprintf(file, "    { \"tester\": ");
+		write_json_string(file, results[i].tester);
+		fprintf(file, ", \"allocator\": ");
+		write_json_string(file, results[i].allocator);
+		fprintf(file, ", \"failures\": %d", results[i].failures);
+		for (j = 0; j < NUM_METRICS; j++)
+		{
+			summary_t *s = &results[i].summary[j];
+			fprintf(file, ", \"%s\": { \"n\": %d, \"mean\": %.9g, \"sd\": %.9g, \"median\": %.9g, \"min\": %.9g }",
+			        metrics[j].json, s->n, s->mean, s->sd, s->median, s->min);
+		}
+		fprintf(file, " }%s\n", (i + 1 < count) ? "," : "");
+	}
+
+	fprintf(file, "  ]\n");
+	fprintf(file, "}\n");
+}
+
+static double json_number(const char *object, const char *key)
+{
+	char pattern[64];
+	snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+
+	const char *p = strstr(object, pattern);
+	return p ? atof(p + strlen(pattern)) : 0;
+}
+
+/*
+ * Reads a JSON string written by write_json_string(), starting just after
+ * its opening quote, into value.  \u escapes outside ASCII, which
+ * write_json_string() never writes, become '?'.
+ */
+static void read_json_string(const char *json, char *value, size_t size)
+{
+	size_t length = 0;
+
+	for (; *json && *json != '"'; json++)
+	{
+		char c = *json;
+
+		if (c == '\\' && json[1])
+		{
+			switch (*++json)
+			{
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				case 'r': c = '\r'; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'u':
+				{
+					unsigned int code = 0;
+					int digits = 0;
+					if (sscanf(json + 1, "%4x%n", &code, &digits) == 1)
+						json += digits;
+					c = code < 0x80 ? (char)code : '?';
+					break;
+				}
+				default: c = *json; break;
+			}
+		}
+
+		if (length + 1 < size)
+			value[length++] = c;
+	}
+
+	value[length] = '\0';
+}
+
+/*
+ * Loads a baseline previously written by write_json().  Returns the number of
+ * results read, or -1 if the file could not be opened.
+ */
+static int load_json(const char *file_name, result_t *results, int max)
+{
+	FILE *file = fopen(file_name, "r");
+	if (!file)
+		return -1;
+
+	int i, count = 0;
+	char line[LINE_LENGTH];
+	while (count < max && fgets(line, sizeof(line), file))
+	{
+		for (i = 0; environment_labels[i]; i++)
+		{
+			char pattern[64];
+			snprintf(pattern, sizeof(pattern), "  \"%s\": \"", environment_labels[i]);
+			if (strncmp(line, pattern, strlen(pattern)) == 0)
+				read_json_string(line + strlen(pattern), base_environment[i], sizeof(base_environment[i]));
+		}
+
+		char *tester = strstr(line, "\"tester\": \"");
+		if (!tester)
+			continue;
+		tester += strlen("\"tester\": \"");
+
+		result_t *r = &results[count];
+		memset(r, 0, sizeof(result_t));
+		read_json_string(tester, r->tester, sizeof(r->tester));
+
+		char *allocator = strstr(line, "\"allocator\": \"");
+		if (allocator)
+		{
+			allocator += strlen("\"allocator\": \"");
+			read_json_string(allocator, r->allocator, sizeof(r->allocator));
+		}
+		r->failures = (int)json_number(line, "failures");
+
+		for (i = 0; i < NUM_METRICS; i++)
+		{
+			char pattern[64];
+			snprintf(pattern, sizeof(pattern), "\"%s\": {", metrics[i].json);
+
+			char *object = strstr(line, pattern);
+			if (!object)
+				continue;
+
+			summary_t *s = &r->summary[i];
+			s->n = (int)json_number(object, "n");
+			s->mean = json_number(object, "mean");
+			s->sd = json_number(object, "sd");
+			s->median = json_number(object, "median");
+			s->min = json_number(object, "min");
+		}
+		count++;
+	}
+
+	fclose(file);
+	return count;
+}
+
+
+/*
+ * A metric has regressed if its mean grew by more than the threshold and the
+ * difference is significant under Welch's t-test at the 95% level.  When both
+ * sides have no variance (heap sizes of deterministic testers), the threshold
+ * alone decides.
+ */
+static int regressed(summary_t *base, summary_t *curr, double threshold)
+{
+	if (base->n == 0 || curr->n == 0)
+		return 0;
+
+	if (curr->mean <= base->mean * (1.0 + threshold / 100.0))
+		return 0;
+
+	double vb = (base->n > 1) ? base->sd * base->sd / base->n : 0;
+	double vc = (curr->n > 1) ? curr->sd * curr->sd / curr->n : 0;
+	if (vb + vc == 0)
+		return 1;
+
+	double t = (curr->mean - base->mean) / sqrt(vb + vc);
+	double df_den = 0;
+	if (base->n > 1)
+		df_den += vb * vb / (base->n - 1);
+	if (curr->n > 1)
+		df_den += vc * vc / (curr->n - 1);
+	double df = (df_den > 0) ? (vb + vc) * (vb + vc) / df_den : 1;
+
+	return t > critical_value(df);
+}
+
+static int compare(result_t *base, int base_count, result_t *results, int count,
+                   double time_threshold, double memory_threshold)
+{
+	int i, j, k, regressions = 0;
+
+	for (i = 0; environment_labels[i]; i++)
+		if (base_environment[i][0] && strcmp(base_environment[i], environment[i]) != 0)
+			printf("\nWarning: baseline %s was \"%s\", now \"%s\".", environment_labels[i], base_environment[i], environment[i]);
+
+	printf("\n%-32s %-12s %16s %16s %9s\n", "TESTER", "METRIC", "BASELINE", "CURRENT", "CHANGE");
+	for (i = 0; i < count; i++)
+	{
+		result_t *b = NULL;
+		for (k = 0; k < base_count; k++)
+			if (strcmp(base[k].tester, results[i].tester) == 0 && strcmp(base[k].allocator, results[i].allocator) == 0)
+				b = &base[k];
+
+		char name[512];
+		result_name(&results[i], name, sizeof(name));
+
+		if (!b)
+		{
+			printf("%-32s (not in baseline)\n", name);
+			continue;
+		}
+
+		if (results[i].failures > b->failures)
+		{
+			printf("%-32s REGRESSION: %d failed runs (baseline %d)\n", name, results[i].failures, b->failures);
+			regressions++;
+		}
+
+		for (j = 0; j < NUM_METRICS; j++)
+		{
+			summary_t *bs = &b->summary[j], *cs = &results[i].summary[j];
+			double change = (bs->mean != 0) ? 100.0 * (cs->mean - bs->mean) / bs->mean : 0;
+			int bad = 0;
+
+			if (metrics[j].gate == GATE_TIME)
+				bad = regressed(bs, cs, time_threshold);
+			else if (metrics[j].gate == GATE_MEMORY)
+				bad = regressed(bs, cs, memory_threshold);
+
+			printf("%-32s %-12s %16.6f %16.6f %+8.2f%%%s\n", name, metrics[j].json,
+			       bs->mean, cs->mean, change, bad ? "  REGRESSION" : "");
+			regressions += bad;
+		}
+	}
+
+	return regressions;
+}
+
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-r reps] [-a alloc.so]... [-j jobs] [-C cpu-list] [-w warmups] [-R] [-n runs]\n", name);
+	printf("       [-o results.json] [-c baseline.json] [-t time%%] [-m memory%%] [tester ...]\n");
+	printf("\n");
+	printf("Runs each tester under mcontest reps times (default 5) and summarizes the results.\n");
+	printf("  -a lib    measure this allocator; repeat to compare several (default ./alloc.so)\n");
+	printf("  -j jobs   run this many jobs at once, each pinned to its own core (default 1)\n");
+	printf("  -C list   cores to run jobs on, e.g. 2-7 (default: the first jobs available cores)\n");
+	printf("  -o file   write the results as JSON, for use as a later baseline\n");
+	printf("  -c file   compare against a baseline and exit nonzero on any regression\n");
+	printf("  -t pct    time regression threshold in percent (default 5)\n");
+	printf("  -m pct    memory regression threshold in percent (default 1)\n");
+	printf("  -w runs   discarded warm-up runs before each measured run (passed to mcontest)\n");
+	printf("  -R        disable address space layout randomization (passed to mcontest)\n");
+	printf("  -n runs   calibrate and record the shim-adjusted time (passed to mcontest)\n");
+	printf("  -x path   mcontest binary to use (default ./mcontest)\n");
+	printf("\n");
+	printf("Example: %s -r 10 -c baseline.json ./tester-4 ./tester-5\n", name);
+	printf("         %s -j 4 -C 0,2,4,6 -a ./alloc.so -a ./alloc-new.so\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	int reps = 5;
+	const char *output_file = NULL;
+	const char *baseline_file = NULL;
+	double time_threshold = 5.0;
+	double memory_threshold = 1.0;
+	const char *allocators[MAX_ALLOCATORS];
+	int num_allocators = 0;
+	int num_jobs = 1;
+	int cores[MAX_JOBS];
+	int num_cores = -1;
+
+	int opt, full = 0;
+	while ((opt = getopt(argc, argv, "r:a:j:C:o:c:t:m:x:w:n:Rh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': reps = atoi(optarg); break;
+			case 'a':
+				if (num_allocators == MAX_ALLOCATORS)
+				{
+					fprintf(stderr, "Too many allocators to compare (at most %d).\n", MAX_ALLOCATORS);
+					usage(argv[0]);
+					return 2;
+				}
+				allocators[num_allocators++] = optarg;
+				break;
+			case 'j': num_jobs = atoi(optarg); break;
+			case 'C':
+				num_cores = parse_cores(optarg, cores, MAX_JOBS);
+				if (num_cores <= 0)
+				{
+					fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+					return 2;
+				}
+				break;
+			case 'o': output_file = optarg; break;
+			case 'c': baseline_file = optarg; break;
+			case 't': time_threshold = atof(optarg); break;
+			case 'm': memory_threshold = atof(optarg); break;
+			case 'x': mcontest_path = optarg; break;
+			case 'w': full = add_option("-w", optarg); break;
+			case 'R': full = add_option("-R", NULL); break;
+			case 'n': full = add_option("-n", optarg); break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+
+		if (full)
+		{
+			fprintf(stderr, "Too many options to pass to mcontest.\n");
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (reps < 1 || reps > MAX_REPS)
+	{
+		fprintf(stderr, "reps must be between 1 and %d\n", MAX_REPS);
+		return 2;
+	}
+
+	if (num_jobs < 1 || num_jobs > MAX_JOBS)
+	{
+		fprintf(stderr, "jobs must be between 1 and %d\n", MAX_JOBS);
+		return 2;
+	}
+
+	/*
+	 * Parallel jobs are pinned one per core, so they never share a core with
+	 * each other.  By default they take the first cores mbench may run on.
+	 * Giving more cores than jobs (e.g. every other core) leaves room between
+	 * them and reduces interference further.
+	 */
+	if (num_cores < 0 && num_jobs > 1)
+	{
+		cpu_set_t available;
+		sched_getaffinity(0, sizeof(available), &available);
+
+		int cpu;
+		num_cores = 0;
+		for (cpu = 0; cpu < CPU_SETSIZE && num_cores < num_jobs; cpu++)
+			if (CPU_ISSET(cpu, &available))
+				cores[num_cores++] = cpu;
+	}
+
+	if (num_cores >= 0 && num_cores < num_jobs)
+	{
+		fprintf(stderr, "%d jobs need at least %d cores, but only %d are available\n", num_jobs, num_jobs, num_cores);
+		return 2;
+	}
+
+	const char **testers = (optind < argc) ? (const char **)argv + optind : default_testers;
+	int i, j, num_testers = 0;
+	while (testers[num_testers])
+		num_testers++;
+
+	if (num_testers > MAX_TESTERS)
+	{
+		fprintf(stderr, "Too many testers (at most %d).\n", MAX_TESTERS);
+		usage(argv[0]);
+		return 2;
+	}
+
+
+	/*
+	 * Load the baseline before running anything, so a typo in its name does
+	 * not cost a full benchmark run.
+	 */
+	result_t *base = NULL;
+	int base_count = 0;
+	if (baseline_file)
+	{
+		base = malloc(MAX_RESULTS * sizeof(result_t));
+		base_count = load_json(baseline_file, base, MAX_RESULTS);
+		if (base_count < 0)
+		{
+			perror(baseline_file);
+			return 2;
+		}
+	}
+
+
+	int count = num_testers * (num_allocators ? num_allocators : 1);
+	result_t *results = calloc(count, sizeof(result_t));
+	for (i = 0; i < num_testers; i++)
+	{
+		for (j = 0; j < (num_allocators ? num_allocators : 1); j++)
+		{
+			result_t *r = &results[i * (num_allocators ? num_allocators : 1) + j];
+			snprintf(r->tester, sizeof(r->tester), "%s", testers[i]);
+			if (num_allocators)
+				snprintf(r->allocator, sizeof(r->allocator), "%s", allocators[j]);
+		}
+	}
+
+	run_all(results, count, reps, num_jobs, (num_cores >= 0) ? cores : NULL);
+
+	printf("%-32s %5s %12s %12s %16s %16s\n", "TESTER", "FAIL", "TIME", "TIME SD", "MAX", "AVG");
+	for (i = 0; i < count; i++)
+	{
+		char name[512];
+		result_name(&results[i], name, sizeof(name));
+		printf("%-32s %5d %12.6f %12.6f %16.0f %16.0f\n", name, results[i].failures,
+		       results[i].summary[0].mean, results[i].summary[0].sd,
+		       results[i].summary[1].mean, results[i].summary[2].mean);
+	}
+
+	if (output_file)
+	{
+		FILE *file = fopen(output_file, "w");
+		if (!file)
+		{
+			perror(output_file);
+			return 2;
+		}
+		write_json(file, results, count, reps);
+		fclose(file);
+	}
+
+	int regressions = 0;
+	if (base)
+	{
+		regressions = compare(base, base_count, results, count, time_threshold, memory_threshold);
+		printf("\n[mbench]: %d regression(s)\n", regressions);
+		free(base);
+	}
+
+	free(results);
+	return regressions ? 1 : 0;
+}
@@ -3,135 +3,613 @@
  * The University of Illinois
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/wait.h> 
+#include <sys/resource.h>
 #include <sys/types.h> 
 #include "contest.h"
+#include "library.h"
 #include <sys/mman.h>
 #include <pthread.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/personality.h>
+#include <sys/utsname.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+volatile int child_pid = 0;
+int perf_available = 0;
+
+double timeval_seconds(struct timeval tv)
+{
+	return tv.tv_sec + ((double)tv.tv_usec / ((double)1000 * 1000));
+}
+
+double timespec_seconds(struct timespec ts)
+{
+	return ts.tv_sec + ((double)ts.tv_nsec / ((double)1000 * 1000 * 1000));
+}
+
+/*
+ * Hardware performance counters opened on the child.  Each counter is opened
+ * on its own (inherit does not support reading a whole group) and counts user
+ * space only, so it works with the default perf_event_paranoid setting.
+ */
+#define CACHE_MISS(cache) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+typedef struct _perf_counter_t
+{
+	const char *label;
+	unsigned int type;
+	unsigned long long config;
+	int fd;
+} perf_counter_t;
+
+perf_counter_t perf_counters[] =
+{
+	{ "CYCLES",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,          -1 },
+	{ "INSTRUCTIONS",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,        -1 },
+	{ "L1D_MISSES",    PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D),  -1 },
+	{ "LLC_MISSES",    PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL),   -1 },
+	{ "DTLB_MISSES",   PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB), -1 },
+	{ "BRANCH_MISSES", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,       -1 },
+};
+
+#define NUM_PERF_COUNTERS (int)(sizeof(perf_counters) / sizeof(perf_counters[0]))
+
+/*
+ * Opens every counter on the (not yet exec'd) child.  The counters start
+ * disabled and are enabled by the kernel when the child calls execve(), so
+ * none of mcontest's own work is counted.  Returns the number of counters
+ * that could be opened.
+ */
+int perf_open(int child_pid)
+{
+	int i, opened = 0;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = perf_counters[i].type;
+		attr.config = perf_counters[i].config;
+		attr.disabled = 1;
+		attr.enable_on_exec = 1;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		perf_counters[i].fd = syscall(SYS_perf_event_open, &attr, child_pid, -1, -1, 0);
+		if (perf_counters[i].fd >= 0)
+			opened++;
+	}
+
+	return opened;
+}
+
+/*
+ * Prints each counter, scaled up if the kernel had to multiplex it, both as
+ * a total and per allocator call.
+ */
+void perf_report(unsigned long memory_uses)
+{
+	int i;
+
+	if (!perf_available)
+		return;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; i++)
+	{
+		unsigned long long values[3];
+		int have_values = 0;
+
+		if (perf_counters[i].fd >= 0)
+		{
+			have_values = read(perf_counters[i].fd, values, sizeof(values)) == sizeof(values);
+			close(perf_counters[i].fd);
+			perf_counters[i].fd = -1;
+		}
+
+		if (!have_values)
+		{
+			printf("[mcontest]: %s: n/a\n", perf_counters[i].label);
+			continue;
+		}
+
+		double count = values[0];
+		if (values[2] > 0 && values[2] < values[1])
+			count = count * values[1] / values[2];
+
+		if (memory_uses == 0)
+			printf("[mcontest]: %s: %.0f\n", perf_counters[i].label, count);
+		else
+			printf("[mcontest]: %s: %.0f (%.2f/call)\n", perf_counters[i].label, count, count / memory_uses);
+	}
+}
+
+/*
+ * The run is limited to timeout_seconds (0 for no limit).  A child that
+ * ignores the SIGTERM is killed outright after a grace period.  Either way
+ * the stats it had published so far are still reported.
+ */
+#define KILL_GRACE_PERIOD 5
 
-int child_still_running = 1;
+unsigned int timeout_seconds = 30;
+volatile int timed_out = 0;
 
 void *timeout_timer(void *ptr)	
 {
-	int child_pid = *((int *)ptr);
+	int pid = (int)(long)ptr;
 	
-	sleep(30);
-	if (child_still_running == 1)
+	sleep(timeout_seconds);
+	if (child_pid == pid)
 	{
-		printf("Sending a SIGTERM to kill the child process (pid=%d) for running for over 30sec.\n", child_pid);
-		if (kill(child_pid, SIGTERM) != 0)
+		timed_out = 1;
+		printf("Sending a SIGTERM to kill the child process (pid=%d) for running for over %usec.\n", pid, timeout_seconds);
+		if (kill(pid, SIGTERM) != 0)
 			if (errno != ESRCH)
 				perror("kill()");
+
+		sleep(KILL_GRACE_PERIOD);
+		if (child_pid == pid)
+		{
+			printf("Sending a SIGKILL to the child process (pid=%d), which ignored the SIGTERM.\n", pid);
+			if (kill(pid, SIGKILL) != 0)
+				if (errno != ESRCH)
+					perror("kill()");
+		}
 	}
 	
 	return NULL;
 }
 
-int main(int argc, char **argv)
+/*
+ * Parses a byte count with an optional K, M, G or T suffix (powers of 1024).
+ * Returns 0 if the size is invalid or does not fit in 64 bits.
+ */
+unsigned long long parse_size(const char *text)
 {
-	/*
-	 * Check to ensure that the program is launched with at least one command
-	 * line option.  Display helpful text if no options are present.
-	 */
-	if (argc == 1)
+	char *end;
+	int shift = 0;
+
+	/* strtoull() would take a minus sign and negate the result. */
+	if (*text < '0' || *text > '9')
+		return 0;
+
+	errno = 0;
+	unsigned long long size = strtoull(text, &end, 10);
+	if (errno == ERANGE)
+		return 0;
+
+	switch (*end)
 	{
-		printf("You must supply a program to be invoked to use your replacement malloc() script.\n");
-		printf("...you may use any program, even system programs, such as `ls`.\n");
-		printf("\n");
-		printf("Example: %s /bin/ls\n", argv[0]);
-		return 1;
+		case 'T': case 't': shift += 10;
+		/* fall through */
+		case 'G': case 'g': shift += 10;
+		/* fall through */
+		case 'M': case 'm': shift += 10;
+		/* fall through */
+		case 'K': case 'k': shift += 10; end++;
 	}
 
-	
-	/*
-	 * Set up a shared memory file for later use by mmap(). 
-	 */
-	char file_name[] = "/tmp/cs241-XXXXXX";
-	int fd = mkstemp(file_name);
-	
-	char *buffer = calloc(1, sizeof(alloc_stats_t));
-	write(fd, buffer, sizeof(alloc_stats_t));
-	close(fd);
-	free(buffer);
+	if (*end != '\0' || size > ULLONG_MAX >> shift)
+		return 0;
+	return size << shift;
+}
 
-	
-	/*
-	 * Set up the environment to pre-load our 'malloc.so' shared library, which
-	 * will replace the malloc(), calloc(), realloc(), and free() that is defined
-	 * by standard libc.
-	 */
-	char **env = malloc(3 * sizeof(char *));
-	env[0] = malloc(1024 * sizeof(char));
-	sprintf(env[0], "LD_PRELOAD=./contest-alloc.so");
+/*
+ * Benchmark noise control.  The CPU list uses the same syntax as taskset -c.
+ */
+cpu_set_t affinity;
+const char *affinity_list = NULL;
+int disable_aslr = 0;
 
-	env[1] = malloc(1024 * sizeof(char));
-	sprintf(env[1], "ALLOC_CONTEST_MMAP=%s", file_name);
+int parse_cpu_list(const char *list, cpu_set_t *set)
+{
+	CPU_ZERO(set);
 
-	env[2] = NULL;
+	while (*list)
+	{
+		char *end;
+		long first = strtol(list, &end, 10), last;
+		if (end == list || first < 0 || first >= CPU_SETSIZE)
+			return -1;
 
-	
+		last = first;
+		if (*end == '-')
+		{
+			list = end + 1;
+			last = strtol(list, &end, 10);
+			if (end == list || last < first || last >= CPU_SETSIZE)
+				return -1;
+		}
+
+		for (; first <= last; first++)
+			CPU_SET(first, set);
+
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		list = end;
+	}
+
+	return 0;
+}
+
+/*
+ * Prints one line of a file with the trailing newline removed, or the
+ * fallback if it cannot be read.  With a prefix, prints the first line
+ * starting with it, minus everything up to the colon.
+ */
+void print_file_line(const char *label, const char *path, const char *prefix, const char *fallback)
+{
+	char line[1024];
+	const char *value = fallback;
+	FILE *file = fopen(path, "r");
+
+	if (file)
+	{
+		while (fgets(line, sizeof(line), file))
+		{
+			if (prefix && strncmp(line, prefix, strlen(prefix)) != 0)
+				continue;
+
+			value = line;
+			if (prefix && strchr(line, ':'))
+				value = strchr(line, ':') + 2;
+			line[strcspn(line, "\n")] = '\0';
+			break;
+		}
+		fclose(file);
+	}
+
+	printf("[mcontest]: %s: %s\n", label, value);
+}
+
+/*
+ * The machine and the settings a report was measured under.  It is printed
+ * ahead of each program's report, so that with -f every command's results
+ * carry their own.
+ */
+void print_environment(const char *allocator, int warmup_runs)
+{
+	struct utsname name;
+
+	print_file_line("CPU", "/proc/cpuinfo", "model name", "unknown");
+	print_file_line("GOVERNOR", "/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", NULL, "n/a");
+	if (uname(&name) == 0)
+		printf("[mcontest]: KERNEL: %s %s\n", name.sysname, name.release);
+	printf("[mcontest]: ALLOCATOR: %s\n", allocator);
+	printf("[mcontest]: AFFINITY: %s\n", affinity_list ? affinity_list : "all");
+	printf("[mcontest]: ASLR: %s\n", disable_aslr ? "off" : "on");
+	printf("[mcontest]: WARMUP: %d\n", warmup_runs);
+}
+
+
+typedef struct _run_t
+{
+	int result;
+	struct rusage resources_used;
+	double wall_time;
+	int timed_out;
+} run_t;
+
+/*
+ * Runs the program once to completion.  Only a measured run has performance
+ * counters attached.  Returns nonzero if the child could not be started or
+ * waited for.
+ */
+int run_child(char **args, char **env, int measured, run_t *run)
+{
 	/*
 	 * Replace the current running process with the process specified by the command
 	 * line options.  If exec() fails, we won't even try and recover as there's likely
 	 * nothing we could really do; however, we do our best to provide useful output
 	 * with a call to perror().
 	 */
+	int sync_pipe[2];
+	if (pipe(sync_pipe) != 0)
+	{
+		perror("pipe()");
+		return 1;
+	}
+
+	fflush(stdout);
 	int forkid = fork();
 	if (forkid == 0)   /* child */
 	{
-		execve(argv[1], argv + 1, env);    /* Note that exec() will not return on success. */
+		/* Wait for the parent to attach the performance counters. */
+		char go;
+		close(sync_pipe[1]);
+		read(sync_pipe[0], &go, 1);
+		close(sync_pipe[0]);
+
+		if (affinity_list && sched_setaffinity(0, sizeof(affinity), &affinity) != 0)
+			perror("sched_setaffinity()");
+		if (disable_aslr && personality(personality(0xffffffff) | ADDR_NO_RANDOMIZE) == -1)
+			perror("personality()");
+
+		execvpe(args[0], args, env);    /* Note that exec() will not return on success. */
 		perror("exec() failed");
-		return 3;
+		exit(3);
 	}
-	free(env[1]);
-	free(env[0]);
-	free(env);
+	close(sync_pipe[0]);
+
+	if (measured)
+	{
+		perf_available = perf_open(forkid);
+		if (!perf_available)
+			fprintf(stderr, "[mcontest]: Hardware performance counters are unavailable (%s); reporting time only.\n", strerror(errno));
+	}
+
+	struct timespec wall_start, wall_end;
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+	write(sync_pipe[1], "g", 1);
+	close(sync_pipe[1]);
 
 	
 	pthread_t tid;
-	pthread_create(&tid, NULL, timeout_timer, &forkid);
-	child_still_running = 1;
+	child_pid = forkid;
+	timed_out = 0;
+	if (timeout_seconds > 0)
+		pthread_create(&tid, NULL, timeout_timer, (void *)(long)forkid);
 	
-	int result;
-	struct rusage resources_used;
-	if (wait4(forkid, &result, 0, &resources_used) == -1)
+	if (wait4(forkid, &run->result, 0, &run->resources_used) == -1)
 	{
 		perror("wait4()");
-		return 4;
+		return 1;
 	}
-	child_still_running = 0;
-	pthread_detach(tid);
-	
-	FILE *file = fopen(file_name, "r");
-	alloc_stats_t *stats = mmap(NULL, sizeof(alloc_stats_t), PROT_READ, MAP_SHARED, fileno(file), 0);
-	if (!stats)
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+	child_pid = 0;
+	if (timeout_seconds > 0)
 	{
-		perror("mmap");
-		return 5;
+		pthread_cancel(tid);
+		pthread_join(tid, NULL);
 	}
-	
-	fclose(file);
-	
-	int total_sec = resources_used.ru_utime.tv_sec + resources_used.ru_stime.tv_sec;
-	int total_usec = resources_used.ru_utime.tv_usec + resources_used.ru_stime.tv_usec;
-	if (total_usec >= 1000 * 1000)
+	run->timed_out = timed_out;
+
+	run->wall_time = timespec_seconds(wall_end) - timespec_seconds(wall_start);
+	return 0;
+}
+
+/* The upper bound of a request size percentile, or 0 without requests. */
+unsigned long long size_percentile(unsigned long *histogram, double fraction)
+{
+	int bucket = percentile_bucket(histogram, SIZE_BUCKETS, fraction);
+	return bucket < 0 ? 0 : size_bucket_limit(bucket);
+}
+
+/*
+ * Allocation profile (-p): every size bucket that was used, every old size
+ * to new size pair that realloc() saw, and the sampled lifetimes by size.
+ */
+int print_profile = 0;
+
+void print_log2_range(int bucket, int buckets)
+{
+	if (bucket <= 1)
+		printf("%d", bucket);
+	else if (bucket == buckets - 1)
+		printf("%llu+", 1ULL << (bucket - 1));
+	else
+		printf("%llu-%llu", 1ULL << (bucket - 1), (1ULL << bucket) - 1);
+}
+
+void print_size_profile(alloc_stats_t *stats)
+{
+	int i, j;
+	unsigned long total = 0;
+
+	for (i = 0; i < SIZE_BUCKETS; i++)
+		total += stats->size_histogram[i];
+
+	for (i = 0; i < SIZE_BUCKETS; i++)
+	{
+		unsigned long count = stats->size_histogram[i];
+		if (count == 0)
+			continue;
+
+		unsigned long long low = i ? size_bucket_limit(i - 1) + 1 : 0;
+		if (i == SIZE_BUCKETS - 1)
+			printf("[mcontest]: SIZE: %llu+: %lu (%.1f%%)\n", low, count, 100.0 * count / total);
+		else
+			printf("[mcontest]: SIZE: %llu-%llu: %lu (%.1f%%)\n", low, size_bucket_limit(i), count, 100.0 * count / total);
+	}
+
+	for (i = 0; i < RESIZE_BUCKETS; i++)
+		for (j = 0; j < RESIZE_BUCKETS; j++)
+		{
+			if (stats->resize_histogram[i][j] == 0)
+				continue;
+
+			printf("[mcontest]: RESIZE: ");
+			print_log2_range(i, RESIZE_BUCKETS);
+			printf(" -> ");
+			print_log2_range(j, RESIZE_BUCKETS);
+			printf(": %lu\n", stats->resize_histogram[i][j]);
+		}
+
+	printf("[mcontest]: LIFETIMES: 1 in %d blocks, in calls, %lu not followed\n",
+	       LIFETIME_SAMPLE, stats->lifetime_dropped);
+	for (i = 0; i < LIFETIME_SIZE_BUCKETS; i++)
+	{
+		for (j = 0; j < LIFETIME_BUCKETS; j++)
+		{
+			if (stats->lifetime_histogram[i][j] == 0)
+				continue;
+
+			printf("[mcontest]: LIFETIME: ");
+			print_log2_range(i, LIFETIME_SIZE_BUCKETS);
+			printf(" bytes, ");
+			print_log2_range(j, LIFETIME_BUCKETS);
+			printf(" calls: %lu\n", stats->lifetime_histogram[i][j]);
+		}
+
+		if (stats->lifetime_unfreed[i])
+		{
+			printf("[mcontest]: LIFETIME: ");
+			print_log2_range(i, LIFETIME_SIZE_BUCKETS);
+			printf(" bytes, never freed: %lu\n", stats->lifetime_unfreed[i]);
+		}
+	}
+}
+
+/*
+ * Clears the counters before a run.  mcontest does this rather than the
+ * shim, because every process the program starts loads the shim too and all
+ * of them add to the same stats.
+ */
+void reset_stats(alloc_stats_t *stats)
+{
+	unsigned long long max_heap_limit = stats->max_heap_limit;
+	int owner_pid = stats->owner_pid;
+
+	memset(stats, 0, sizeof(alloc_stats_t));
+	stats->max_heap_limit = max_heap_limit;
+	stats->owner_pid = owner_pid;
+}
+
+/*
+ * Shim overhead calibration (-n).  The program is run without the shim at
+ * all, and through the shim with libc as the allocator.  The difference in
+ * CPU time, divided by the program's calls, is the shim's cost per call:
+ * the extra indirection, sbrk(0) and shared-memory updates.  The fastest of
+ * several runs of each is used, since noise only ever adds time.
+ *
+ * Only the program's own calls are counted, not those the allocator makes
+ * through the shim itself.  libc's use of brk() and mmap() differs from the
+ * allocator's, so system time is reported apart from user time: a large
+ * difference there means the per-call figure is not all shim.
+ */
+int calibration_runs = 0;
+char **bare_env = NULL;
+char **libc_env = NULL;
+
+typedef struct _cpu_time_t
+{
+	double user;
+	double system;
+} cpu_time_t;
+
+typedef struct _overhead_t
+{
+	cpu_time_t bare;
+	cpu_time_t shim;
+	double per_call;
+} overhead_t;
+
+/* The calls the program itself made, leaving out any the allocator made. */
+unsigned long program_calls(alloc_stats_t *stats)
+{
+	int i;
+	unsigned long calls = 0;
+
+	for (i = 0; i < OP_TYPES; i++)
+		calls += stats->op_counts[i];
+	return calls;
+}
+
+int fastest_run(char **args, char **env, alloc_stats_t *stats, cpu_time_t *fastest, unsigned long *calls)
+{
+	int i;
+	run_t run;
+
+	for (i = 0; i < calibration_runs; i++)
+	{
+		reset_stats(stats);
+		if (run_child(args, env, 0, &run) != 0)
+			return 1;
+
+		double user = timeval_seconds(run.resources_used.ru_utime);
+		double system = timeval_seconds(run.resources_used.ru_stime);
+		if (i == 0 || user + system < fastest->user + fastest->system)
+		{
+			fastest->user = user;
+			fastest->system = system;
+		}
+	}
+
+	if (calls)
+		*calls = program_calls(stats);
+	return 0;
+}
+
+int calibrate(char **args, alloc_stats_t *stats, overhead_t *overhead)
+{
+	unsigned long calls;
+
+	if (fastest_run(args, bare_env, stats, &overhead->bare, NULL) != 0 ||
+	    fastest_run(args, libc_env, stats, &overhead->shim, &calls) != 0)
+		return 1;
+
+	double bare_time = overhead->bare.user + overhead->bare.system;
+	double shim_time = overhead->shim.user + overhead->shim.system;
+
+	overhead->per_call = 0;
+	if (calls > 0 && shim_time > bare_time)
+		overhead->per_call = (shim_time - bare_time) / calls;
+
+	return 0;
+}
+
+/*
+ * Runs the program (after any warm-up runs) and prints its report.  Returns
+ * nonzero if it could not be run at all.
+ */
+int measure(char **args, char **env, int warmup_runs, alloc_stats_t *stats)
+{
+	overhead_t overhead;
+	if (calibration_runs > 0 && calibrate(args, stats, &overhead) != 0)
+		return 4;
+
+	/*
+	 * Warm-up runs fill the page cache and CPU caches and settle the frequency
+	 * governor; their results are thrown away.
+	 */
+	int i;
+	run_t run;
+	for (i = 0; i < warmup_runs; i++)
 	{
-		total_usec -= 1000 * 1000;
-		total_sec++;
+		reset_stats(stats);
+		if (run_child(args, env, 0, &run) != 0)
+			return 4;
 	}
-	double total_time = total_sec + ((double)total_usec / ((double)1000 * 1000));
+
+	reset_stats(stats);
+	if (run_child(args, env, 1, &run) != 0)
+		return 4;
 	
+	struct rusage resources_used = run.resources_used;
+	double user_time = timeval_seconds(resources_used.ru_utime);
+	double system_time = timeval_seconds(resources_used.ru_stime);
+	double total_time = user_time + system_time;
 	
-	if (result == 0)
+	
+	if (run.result == 0)
 		printf("[mcontest]: STATUS: OK\n");
 	else
-		printf("[mcontest]: STATUS: FAILED=(%d)\n", result);
+		printf("[mcontest]: STATUS: FAILED=(%d)\n", run.result);
+
+	if (run.timed_out)
+	{
+		printf("[mcontest]: TIMEOUT: %u\n", timeout_seconds);
+		printf("[mcontest]: PARTIAL: the counts below miss up to %d calls per thread, not yet published when the program was killed\n",
+		       PUBLISH_INTERVAL);
+	}
 	
 	printf("[mcontest]: MAX: %llu\n", stats->max_heap_used);
 	
@@ -141,9 +619,342 @@ int main(int argc, char **argv)
 		printf("[mcontest]: AVG: %f\n", (stats->memory_heap_sum / (double)stats->memory_uses));
 	
 	printf("[mcontest]: TIME: %f\n", total_time);
+	printf("[mcontest]: USER: %f\n", user_time);
+	printf("[mcontest]: SYSTEM: %f\n", system_time);
+	printf("[mcontest]: WALL: %f\n", run.wall_time);
+
+	/*
+	 * Page faults show the cost of growing the heap: every new page the
+	 * allocator touches is a minor fault, no matter how it was obtained.
+	 */
+	printf("[mcontest]: MINFLT: %ld\n", resources_used.ru_minflt);
+	printf("[mcontest]: MAJFLT: %ld\n", resources_used.ru_majflt);
+	printf("[mcontest]: NVCSW: %ld\n", resources_used.ru_nvcsw);
+	printf("[mcontest]: NIVCSW: %ld\n", resources_used.ru_nivcsw);
+	printf("[mcontest]: MAXRSS: %ld kB\n", resources_used.ru_maxrss);
+
+	if (calibration_runs > 0)
+	{
+		double shim_cost = overhead.per_call * program_calls(stats);
+		double alloc_time = total_time - shim_cost;
+		printf("[mcontest]: BARE_TIME: %f\n", overhead.bare.user + overhead.bare.system);
+		printf("[mcontest]: BARE_USER: %f\n", overhead.bare.user);
+		printf("[mcontest]: BARE_SYSTEM: %f\n", overhead.bare.system);
+		printf("[mcontest]: SHIM_TIME: %f\n", overhead.shim.user + overhead.shim.system);
+		printf("[mcontest]: SHIM_USER: %f\n", overhead.shim.user);
+		printf("[mcontest]: SHIM_SYSTEM: %f\n", overhead.shim.system);
+		printf("[mcontest]: SHIM_OVERHEAD: %.1f ns/call\n", overhead.per_call * 1e9);
+		printf("[mcontest]: ADJUSTED_TIME: %f\n", alloc_time);
+
+		/* The estimate cannot be right if it takes away more than the run took. */
+		if (alloc_time < 0)
+			fprintf(stderr, "[mcontest]: The estimated shim overhead (%f s) is more than the run took; "
+			        "ADJUSTED_TIME is not meaningful (compare SHIM_SYSTEM with BARE_SYSTEM).\n", shim_cost);
+	}
+	printf("[mcontest]: OPS: malloc=%lu calloc=%lu realloc=%lu free=%lu memalign=%lu\n",
+	       stats->op_counts[OP_MALLOC], stats->op_counts[OP_CALLOC], stats->op_counts[OP_REALLOC],
+	       stats->op_counts[OP_FREE], stats->op_counts[OP_MEMALIGN]);
+	if (stats->live_tracked)
+		printf("[mcontest]: LIVE: %lld\n", stats->live_bytes);
+	printf("[mcontest]: LATENCY: p50=%llu p90=%llu p99=%llu ns (sampled)\n",
+	       latency_percentile(stats->latency_histogram, 0.50),
+	       latency_percentile(stats->latency_histogram, 0.90),
+	       latency_percentile(stats->latency_histogram, 0.99));
+	/*
+	 * realloc() outcomes: what the shim saw (fit is a block kept in place
+	 * because the new size fit in it), and what the allocator itself counted,
+	 * if it says.  Moves are where realloc() time goes.
+	 */
+	printf("[mcontest]: REALLOC: grown=%lu shrunk=%lu moved=%lu copied<=%llu\n",
+	       stats->realloc_outcomes[REALLOC_GROWN], stats->realloc_outcomes[REALLOC_SHRUNK],
+	       stats->realloc_outcomes[REALLOC_MOVED], stats->realloc_copied);
+	if (stats->alloc_realloc_reported)
+		printf("[mcontest]: ALLOC_REALLOC: grown=%lu shrunk=%lu moved=%lu copied=%llu\n",
+		       stats->alloc_realloc_outcomes[REALLOC_GROWN], stats->alloc_realloc_outcomes[REALLOC_SHRUNK],
+		       stats->alloc_realloc_outcomes[REALLOC_MOVED], stats->alloc_realloc_copied);
+	printf("[mcontest]: SIZES: p50=%llu p90=%llu p99=%llu bytes\n",
+	       size_percentile(stats->size_histogram, 0.50),
+	       size_percentile(stats->size_histogram, 0.90),
+	       size_percentile(stats->size_histogram, 0.99));
+	if (print_profile)
+		print_size_profile(stats);
+	perf_report(stats->memory_uses);
+	fflush(stdout);
 
-	munmap(stats, sizeof(alloc_stats_t));
-	unlink(file_name);
 	return 0;
 }
 
+/*
+ * Copies our own environment for the child, adding the shim in front of any
+ * LD_PRELOAD already set and replacing any stale ALLOC_CONTEST_ variables.
+ */
+char **build_environment(const char *shim_path, const char *alloc_path, const char *mmap_path)
+{
+	int i, count = 0;
+	const char *preload = getenv("LD_PRELOAD");
+
+	while (environ[count])
+		count++;
+
+	char **env = malloc((count + 4) * sizeof(char *));
+	int n = 0;
+
+	env[n] = malloc(strlen(shim_path) + (preload ? strlen(preload) : 0) + 16);
+	if (preload && *preload)
+		sprintf(env[n++], "LD_PRELOAD=%s:%s", shim_path, preload);
+	else
+		sprintf(env[n++], "LD_PRELOAD=%s", shim_path);
+
+	env[n] = malloc(strlen(mmap_path) + 32);
+	sprintf(env[n++], "ALLOC_CONTEST_MMAP=%s", mmap_path);
+
+	env[n] = malloc(strlen(alloc_path) + 32);
+	sprintf(env[n++], "ALLOC_CONTEST_LIB=%s", alloc_path);
+
+	for (i = 0; i < count; i++)
+	{
+		if (strncmp(environ[i], "LD_PRELOAD=", 11) == 0 || strncmp(environ[i], "ALLOC_CONTEST_", 14) == 0)
+			continue;
+		env[n++] = strdup(environ[i]);
+	}
+	env[n] = NULL;
+
+	return env;
+}
+
+/*
+ * Splits a workload file line into arguments at whitespace, in place.  There
+ * is no quoting; wrap anything more complex in a script.  Returns the number
+ * of arguments, which is zero for blank and comment lines.
+ */
+int split_command(char *line, char **args, int max)
+{
+	int count = 0;
+	char *token = strtok(line, " \t");
+
+	if (token && token[0] == '#')
+		return 0;
+
+	while (token && count < max - 1)
+	{
+		args[count++] = token;
+		token = strtok(NULL, " \t");
+	}
+	args[count] = NULL;
+
+	return count;
+}
+
+/*
+ * Parses a count or a number of seconds: digits only, 0 to INT_MAX.  Returns
+ * -1 for anything else.
+ */
+int parse_count(const char *text)
+{
+	char *end;
+
+	errno = 0;
+	long value = strtol(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || value < 0 || value > INT_MAX)
+		return -1;
+	return (int)value;
+}
+
+void usage(const char *name)
+{
+	printf("Usage: %s [-a alloc.so] [-c cpu-list] [-l] [-m max-heap] [-n runs] [-p] [-R] [-t seconds] [-w warmup-runs] program [args...]\n", name);
+	printf("       %s [options] -f workload-file\n", name);
+	printf("  -a alloc.so   allocator library to measure (default ./alloc.so)\n");
+	printf("  -c cpu-list   pin the program to the given CPUs, e.g. 2 or 0-3,6\n");
+	printf("  -f file       measure each command in the file, one per line (# starts a comment)\n");
+	printf("  -l            print the stats file to watch the program with mtop while it runs\n");
+	printf("  -m max-heap   stop the program once its heap exceeds this size, e.g. 64G (default 2G)\n");
+	printf("  -n runs       calibrate: also run without the shim and with libc behind it, this many\n");
+	printf("                times each, and subtract the shim's per-call cost from TIME\n");
+	printf("  -p            print the allocation profile: the requests made in each size range,\n");
+	printf("                the old and new sizes of every realloc(), and how long blocks of\n");
+	printf("                each size live\n");
+	printf("  -R            disable address space layout randomization\n");
+	printf("  -t seconds    stop the program after this long, 0 for no limit (default 30)\n");
+	printf("  -w runs       run the program this many times first and discard the results\n");
+	printf("\n");
+	printf("Example: %s /bin/ls\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	/*
+	 * Check to ensure that the program is launched with at least one command
+	 * line option.  Display helpful text if no options are present.
+	 */
+	int i, opt, warmup_runs = 0;
+	const char *allocator = NULL;
+	const char *workload_file = NULL;
+	int live = 0;
+	unsigned long long max_heap = 1024L * 1024L * 1024L * 2L;
+	while ((opt = getopt(argc, argv, "+a:c:f:lm:n:pRt:w:")) != -1)
+	{
+		const char *invalid = NULL;
+		int count = 0;
+
+		if (opt == 't' || opt == 'n' || opt == 'w')
+			count = parse_count(optarg);
+
+		switch (opt)
+		{
+			case 'm':
+				max_heap = parse_size(optarg);
+				if (max_heap == 0)
+					invalid = "memory limit";
+				break;
+			case 't':
+				timeout_seconds = count;
+				if (count < 0)
+					invalid = "timeout";
+				break;
+			case 'a': allocator = optarg; break;
+			case 'f': workload_file = optarg; break;
+			case 'l': live = 1; break;
+			case 'n':
+				calibration_runs = count;
+				if (count < 0)
+					invalid = "number of calibration runs";
+				break;
+			case 'p': print_profile = 1; break;
+			case 'c':
+				if (parse_cpu_list(optarg, &affinity) != 0)
+					invalid = "CPU list";
+				affinity_list = optarg;
+				break;
+			case 'R': disable_aslr = 1; break;
+			case 'w':
+				warmup_runs = count;
+				if (count < 0)
+					invalid = "number of warm-up runs";
+				break;
+			default:
+				/* getopt() has already said what was wrong. */
+				usage(argv[0]);
+				return 1;
+		}
+
+		if (invalid)
+		{
+			fprintf(stderr, "Invalid %s: %s\n", invalid, optarg);
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind >= argc && !workload_file)
+	{
+		printf("You must supply a program to be invoked to use your replacement malloc() script.\n");
+		printf("...you may use any program, even system programs, such as `ls`.\n");
+		printf("\n");
+		usage(argv[0]);
+		return 1;
+	}
+
+	
+	/*
+	 * Set up a shared memory file for later use by mmap(). 
+	 */
+	char file_name[] = "/tmp/cs241-XXXXXX";
+	int fd = mkstemp(file_name);
+	
+	alloc_stats_t *buffer = calloc(1, sizeof(alloc_stats_t));
+	buffer->max_heap_limit = max_heap;
+	buffer->owner_pid = getpid();
+	write(fd, buffer, sizeof(alloc_stats_t));
+	close(fd);
+	free(buffer);
+
+	
+	/*
+	 * Set up the environment to pre-load our 'malloc.so' shared library, which
+	 * will replace the malloc(), calloc(), realloc(), and free() that is defined
+	 * by standard libc.  The rest of our environment is passed on unchanged, so
+	 * real programs behave as they would outside of mcontest.
+	 */
+	char *shim_path = find_library("contest-alloc.so");
+	char *alloc_path = allocator ? realpath(allocator, NULL) : find_library("alloc.so");
+	if (!shim_path || !alloc_path)
+	{
+		fprintf(stderr, "Unable to find %s.\n", !shim_path ? "contest-alloc.so" : (allocator ? allocator : "alloc.so"));
+		return 1;
+	}
+
+	char **env = build_environment(shim_path, alloc_path, file_name);
+	if (calibration_runs > 0)
+	{
+		bare_env = environ;
+		libc_env = build_environment(shim_path, "libc", file_name);
+	}
+
+	FILE *file = fopen(file_name, "r+");
+	alloc_stats_t *stats = mmap(NULL, sizeof(alloc_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+	if (stats == MAP_FAILED)
+	{
+		perror("mmap");
+		return 5;
+	}
+	
+	fclose(file);
+
+
+	if (live)
+		fprintf(stderr, "[mcontest]: Watch this run with: mtop %s\n", file_name);
+
+
+	/*
+	 * With -f, every command in the workload file is measured in turn, each
+	 * with its own report.
+	 */
+	int status = 0;
+	if (workload_file)
+	{
+		file = fopen(workload_file, "r");
+		if (!file)
+		{
+			perror(workload_file);
+			return 1;
+		}
+
+		char line[4096];
+		char *args[256];
+		while (fgets(line, sizeof(line), file))
+		{
+			line[strcspn(line, "\r\n")] = '\0';
+			if (split_command(line, args, 256) == 0)
+				continue;
+
+			printf("[mcontest]: COMMAND:");
+			for (i = 0; args[i]; i++)
+				printf(" %s", args[i]);
+			printf("\n");
+
+			print_environment(alloc_path, warmup_runs);
+			if ((status = measure(args, env, warmup_runs, stats)) != 0)
+				break;
+		}
+		fclose(file);
+	}
+	else
+	{
+		print_environment(alloc_path, warmup_runs);
+		status = measure(argv + optind, env, warmup_runs, stats);
+	}
+
+	for (i = 0; env[i]; i++)
+		free(env[i]);
+	free(env);
+	for (i = 0; libc_env && libc_env[i]; i++)
+		free(libc_env[i]);
+	free(libc_env);
+	free(shim_path);
+	free(alloc_path);
+
+	munmap(stats, sizeof(alloc_stats_t));
+	unlink(file_name);
+	return status;
+}
@@ -3,9 +3,14 @@
  * The University of Illinois
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <limits.h>
+#include "library.h"
 
 int main(int argc, char **argv)
 {
@@ -26,13 +31,33 @@ int main(int argc, char **argv)
 	/*
 	 * Set up the environment to pre-load our 'malloc.so' shared library, which
 	 * will replace the malloc(), calloc(), realloc(), and free() that is defined
-	 * by standard libc.
+	 * by standard libc.  The rest of our environment is passed on unchanged, and
+	 * any LD_PRELOAD already set is kept after ours.
 	 */
-	char **env = malloc(2 * sizeof(char *));
-	env[0] = malloc(100 * sizeof(char));
-	sprintf(env[0], "LD_PRELOAD=./alloc.so");
+	char *alloc_path = find_library("alloc.so");
+	if (!alloc_path)
+	{
+		fprintf(stderr, "Unable to find alloc.so.\n");
+		return 1;
+	}
+
+	int i, count = 0;
+	const char *preload = getenv("LD_PRELOAD");
+	while (environ[count])
+		count++;
+
+	char **env = malloc((count + 2) * sizeof(char *));
+	env[0] = malloc(strlen(alloc_path) + (preload ? strlen(preload) : 0) + 16);
+	if (preload && *preload)
+		sprintf(env[0], "LD_PRELOAD=%s:%s", alloc_path, preload);
+	else
+		sprintf(env[0], "LD_PRELOAD=%s", alloc_path);
 
-	env[1] = NULL;
+	int n = 1;
+	for (i = 0; i < count; i++)
+		if (strncmp(environ[i], "LD_PRELOAD=", 11) != 0)
+			env[n++] = environ[i];
+	env[n] = NULL;
 
 
 	/*
@@ -41,11 +66,12 @@ int main(int argc, char **argv)
 	 * nothing we could really do; however, we do our best to provide useful output
 	 * with a call to perror().
 	 */
-	execve(argv[1], argv + 1, env);    /* Note that exec() will not return on success. */
+	execvpe(argv[1], argv + 1, env);    /* Note that exec() will not return on success. */
 	perror("exec() failed");
 
 	free(env[0]);
 	free(env);
+	free(alloc_path);
 
 
 	return 2;
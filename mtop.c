@@ -0,0 +1,207 @@
+/*
+ * CS 241
+ * The University of Illinois
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "contest.h"
+
+/* How long to wait for mcontest to fill in a stats file it has only just made. */
+#define STARTUP_WAIT_MS 5000
+#define STARTUP_POLL_MS 50
+
+static const char *op_names[OP_TYPES] = { "malloc", "calloc", "realloc", "free", "memalign" };
+
+/* Whether a process is still running.  Pids of 0 and below are never a process. */
+int running(int pid)
+{
+	if (pid <= 0)
+		return 0;
+	return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+/*
+ * mkstemp() creates the stats file empty and mcontest writes it right
+ * after, so mtop can get there first.  Waits for the whole file, then for
+ * owner_pid to name a process; returns the mapping, or NULL if neither
+ * turns up in time.
+ */
+alloc_stats_t *wait_for_stats(int fd, const char *file_name)
+{
+	int waited;
+	struct stat st;
+	alloc_stats_t *stats = NULL;
+
+	for (waited = 0; waited <= STARTUP_WAIT_MS; waited += STARTUP_POLL_MS)
+	{
+		if (!stats && fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(alloc_stats_t))
+		{
+			stats = mmap(NULL, sizeof(alloc_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+			if (stats == MAP_FAILED)
+			{
+				perror("mmap");
+				return NULL;
+			}
+		}
+
+		if (stats && __atomic_load_n(&stats->owner_pid, __ATOMIC_RELAXED) > 0)
+			return stats;
+		usleep(STARTUP_POLL_MS * 1000);
+	}
+
+	fprintf(stderr, "%s: not a stats file from a running mcontest\n", file_name);
+	if (stats)
+		munmap(stats, sizeof(alloc_stats_t));
+	return NULL;
+}
+
+/* Resident set size of a process in kB, or -1 if it has gone. */
+long read_rss(int pid)
+{
+	char path[64], line[256];
+	long rss = -1;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return -1;
+
+	while (fgets(line, sizeof(line), file))
+		if (sscanf(line, "VmRSS: %ld", &rss) == 1)
+			break;
+
+	fclose(file);
+	return rss;
+}
+
+void print_bytes(const char *label, double bytes)
+{
+	const char *units[] = { "B", "KB", "MB", "GB", "TB" };
+	int unit = 0;
+
+	while (bytes >= 1024 && unit < 4)
+	{
+		bytes /= 1024;
+		unit++;
+	}
+
+	printf("  %-14s %10.2f %s\n", label, bytes, units[unit]);
+}
+
+void draw(alloc_stats_t *now, alloc_stats_t *before, int interval, long rss)
+{
+	int i;
+	unsigned long interval_latency[LATENCY_BUCKETS];
+
+	/* Clear the screen and home the cursor. */
+	printf("\033[H\033[2J");
+	printf("mtop: pid %d%s\n\n", now->pid, rss < 0 ? " (exited)" : "");
+
+	printf("  %-14s %12s %14s\n", "CALL", "PER SECOND", "TOTAL");
+	for (i = 0; i < OP_TYPES; i++)
+		printf("  %-14s %12.0f %14lu\n", op_names[i],
+		       (double)(now->op_counts[i] - before->op_counts[i]) / interval, now->op_counts[i]);
+	printf("\n");
+
+	print_bytes("heap", now->current_heap);
+	print_bytes("peak heap", now->max_heap_used);
+	if (rss >= 0)
+		print_bytes("rss", rss * 1024.0);
+
+	/*
+	 * Fragmentation: how much of the heap is not holding live blocks.  Only
+	 * known when the allocator reports the usable size of its blocks.
+	 */
+	if (now->live_tracked && now->live_bytes > 0)
+	{
+		print_bytes("live", now->live_bytes);
+		printf("  %-14s %10.2f x\n", "heap / live", (double)now->current_heap / now->live_bytes);
+		printf("  %-14s %10.1f %%\n", "unused heap",
+		       now->current_heap > (unsigned long long)now->live_bytes ?
+		       100.0 * (now->current_heap - now->live_bytes) / now->current_heap : 0.0);
+	}
+	else
+		printf("  %-14s %13s\n", "live", "n/a");
+	printf("\n");
+
+	for (i = 0; i < LATENCY_BUCKETS; i++)
+		interval_latency[i] = now->latency_histogram[i] - before->latency_histogram[i];
+
+	printf("  %-14s %10s %10s %10s\n", "LATENCY (ns)", "p50", "p90", "p99");
+	printf("  %-14s %10llu %10llu %10llu\n", "last interval",
+	       latency_percentile(interval_latency, 0.50),
+	       latency_percentile(interval_latency, 0.90),
+	       latency_percentile(interval_latency, 0.99));
+	printf("  %-14s %10llu %10llu %10llu\n", "overall",
+	       latency_percentile(now->latency_histogram, 0.50),
+	       latency_percentile(now->latency_histogram, 0.90),
+	       latency_percentile(now->latency_histogram, 0.99));
+
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	int interval = 1;
+
+	if (argc > 2)
+		interval = atoi(argv[2]);
+
+	if (argc < 2 || interval < 1)
+	{
+		printf("Watches a program running under mcontest.\n");
+		printf("\n");
+		printf("Usage: %s stats-file [seconds]\n", argv[0]);
+		printf("\n");
+		printf("Start the program with `mcontest -l ...`, which prints the stats file to use.\n");
+		return 1;
+	}
+
+	int fd = open(argv[1], O_RDONLY);
+	if (fd < 0)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+
+	alloc_stats_t *stats = wait_for_stats(fd, argv[1]);
+	close(fd);
+	if (!stats)
+		return 1;
+
+	/*
+	 * Snapshot the shared stats once per interval; rates are the difference
+	 * between snapshots.  Keep going until mcontest exits: the program's own
+	 * pid only covers one run, and with warm-up runs or -f others follow it.
+	 */
+	alloc_stats_t before, now;
+	memcpy(&before, stats, sizeof(alloc_stats_t));
+
+	for (;;)
+	{
+		sleep(interval);
+		memcpy(&now, stats, sizeof(alloc_stats_t));
+
+		/* mcontest clears the stats between warm-up runs. */
+		if (now.memory_uses < before.memory_uses)
+			memset(&before, 0, sizeof(alloc_stats_t));
+
+		long rss = now.pid ? read_rss(now.pid) : -1;
+		draw(&now, &before, interval, rss);
+
+		if (!running(now.owner_pid))
+			break;
+		before = now;
+	}
+
+	munmap(stats, sizeof(alloc_stats_t));
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Helpers shared by the testers: a fast seedable random number generator,
+ * a clock, and memory for a tester's own bookkeeping that stays off the
+ * heap under test.
+ */
+#ifndef _COMMON_H_
+#define _COMMON_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* xorshift64*; seed it by setting rng_state to any odd value. */
+static unsigned long long rng_state = 1;
+
+static inline unsigned long long rng_next()
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+/* Monotonic wall-clock time in seconds. */
+static inline double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Memory for a tester's own tables (slot arrays, samples, key orders and
+ * the like) comes straight from mmap() rather than from malloc().  That
+ * keeps it out of the heap being measured, so the heap holds only the
+ * blocks the workload is about, and the shim, which only counts mappings
+ * the allocator makes, does not count it either.  Exits on failure.
+ */
+static inline void *map(size_t size)
+{
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+	{
+		perror("mmap");
+		exit(1);
+	}
+	return ptr;
+}
+
+/*
+ * The top of the heap, for testers that measure how far sbrk() moves.
+ * Call it after the first printf(): stdio allocates stdout's buffer then,
+ * and it should not be counted as the workload's.
+ */
+static inline char *heap_mark()
+{
+	fflush(stdout);
+	return (char *)sbrk(0);
+}
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ * align: checks that blocks are aligned as promised, and uses them the way
+ * vectorised code does, with aligned SIMD loads and stores that fault if
+ * the address is wrong.
+ *
+ *   malloc(), calloc() and realloc() blocks of many sizes must be aligned
+ *   for any type (alignof(max_align_t), 16 bytes on x86-64), and are
+ *   written and read with aligned SSE
+ *   memalign(), posix_memalign() and aligned_alloc() blocks, aligned from
+ *   16 to 4096 bytes and to 2 MB, must honour their alignment, and those
+ *   aligned to 32 or more are written and read with aligned AVX where the
+ *   processor has it
+ *   malloc_usable_size() must be at least the size asked for, must not
+ *   change while the block is live, and all of it must be usable without
+ *   touching the blocks around it
+ *   posix_memalign() must reject an alignment of 0, one that is not a
+ *   power of two or one smaller than a pointer with EINVAL
+ *   sizes so close to SIZE_MAX that adding the alignment padding would
+ *   overflow must fail, not wrap around to a small block
+ *
+ * Usage: tester-align
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <malloc.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_SIMD 1
+#else
+#define HAVE_SIMD 0
+#endif
+
+#define NEIGHBOURS 3
+#define HUGE_ALIGNMENT (2UL * 1024 * 1024)
+
+static const size_t sizes[] = {
+	0, 1, 7, 8, 9, 15, 16, 17, 23, 24, 25, 31, 32, 33, 48, 63, 64, 65, 100, 127, 128, 129,
+	255, 256, 1000, 1024, 4095, 4096, 4097, 65536, 100000, 1024 * 1024, 2 * 1024 * 1024 + 1
+};
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+long checks, failures;
+int have_avx;
+
+void expect(int ok, const char *what, size_t size, size_t alignment, void *ptr)
+{
+	checks++;
+	if (ok)
+		return;
+
+	failures++;
+	printf("[align]: FAILED: %s (size %zu, alignment %zu, %p)\n", what, size, alignment, ptr);
+}
+
+void *check(void *ptr)
+{
+	if (ptr == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+#if HAVE_SIMD
+/* Aligned SSE stores and loads over every whole 16 bytes of the block. */
+void sse_touch(unsigned char *ptr, size_t size)
+{
+	size_t i;
+	__m128i sum = _mm_setzero_si128();
+
+	for (i = 0; i + 16 <= size; i += 16)
+		_mm_store_si128((__m128i *)(ptr + i), _mm_set1_epi8((char)i));
+	for (i = 0; i + 16 <= size; i += 16)
+		sum = _mm_add_epi8(sum, _mm_load_si128((__m128i *)(ptr + i)));
+
+	volatile int sink = _mm_cvtsi128_si32(sum);
+	(void)sink;
+}
+
+/* The same with 32-byte AVX, compiled for AVX on its own so the rest runs anywhere. */
+__attribute__((target("avx")))
+void avx_touch(unsigned char *ptr, size_t size)
+{
+	size_t i;
+	__m256 sum = _mm256_setzero_ps();
+
+	for (i = 0; i + 32 <= size; i += 32)
+		_mm256_store_ps((float *)(ptr + i), _mm256_set1_ps((float)i));
+	for (i = 0; i + 32 <= size; i += 32)
+		sum = _mm256_add_ps(sum, _mm256_load_ps((float *)(ptr + i)));
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, sum);
+	volatile float sink = lanes[0];
+	(void)sink;
+}
+#endif
+
+/*
+ * Fills all of a block's usable size while blocks allocated around it hold
+ * a pattern, then checks nothing leaked into them.
+ */
+void check_usable(size_t size)
+{
+	int i;
+	unsigned char *blocks[2 * NEIGHBOURS + 1];
+	size_t usable[2 * NEIGHBOURS + 1];
+
+	for (i = 0; i < 2 * NEIGHBOURS + 1; i++)
+	{
+		blocks[i] = check(malloc(size));
+		usable[i] = malloc_usable_size(blocks[i]);
+		expect(usable[i] >= size, "malloc_usable_size() below the size asked for", size, 0, blocks[i]);
+		memset(blocks[i], 0xa0 + i, usable[i]);
+	}
+
+	unsigned char *middle = blocks[NEIGHBOURS];
+	memset(middle, 0x55, usable[NEIGHBOURS]);
+
+	for (i = 0; i < 2 * NEIGHBOURS + 1; i++)
+	{
+		size_t j;
+		int intact = 1;
+
+		expect(malloc_usable_size(blocks[i]) == usable[i], "malloc_usable_size() changed", size, 0, blocks[i]);
+		if (i == NEIGHBOURS)
+			continue;
+		for (j = 0; j < usable[i]; j++)
+			intact &= blocks[i][j] == 0xa0 + i;
+		expect(intact, "writing a block's usable size changed a neighbour", size, 0, blocks[i]);
+	}
+
+	for (i = 0; i < 2 * NEIGHBOURS + 1; i++)
+		free(blocks[i]);
+}
+
+void check_block(unsigned char *ptr, size_t size, size_t alignment, const char *call)
+{
+	char what[64];
+
+	snprintf(what, sizeof(what), "%s() block not aligned", call);
+	expect((uintptr_t)ptr % alignment == 0, what, size, alignment, ptr);
+	if (size > 0)
+		expect(malloc_usable_size(ptr) >= size, "malloc_usable_size() below the size asked for", size, alignment, ptr);
+
+#if HAVE_SIMD
+	/* Only once it is known to be aligned; an unaligned one would fault rather than fail. */
+	if ((uintptr_t)ptr % alignment != 0)
+		return;
+	if (alignment >= 16)
+		sse_touch(ptr, size);
+	if (alignment >= 32 && have_avx)
+		avx_touch(ptr, size);
+#endif
+}
+
+void check_invalid()
+{
+	static const size_t alignments[] = { 0, 1, 4, 24, 48, 4095 };
+	size_t i;
+
+	for (i = 0; i < sizeof(alignments) / sizeof(alignments[0]); i++)
+	{
+		void *ptr = NULL;
+		expect(posix_memalign(&ptr, alignments[i], 64) == EINVAL, "posix_memalign() did not reject the alignment with EINVAL", 64, alignments[i], ptr);
+	}
+}
+
+/*
+ * Sizes whose padded request overflows.  All must fail cleanly; a wrapped
+ * size would come back as a block far smaller than its header claims.
+ */
+void check_overflow()
+{
+	size_t alignment, slack;
+	/* Volatile, or gcc rejects the calls at compile time. */
+	volatile size_t size_max = SIZE_MAX;
+
+	for (alignment = 16; alignment <= 4096; alignment *= 16)
+	{
+		for (slack = 0; slack <= 64; slack += 32)
+		{
+			size_t size = size_max - slack;
+			void *ptr = memalign(alignment, size);
+			expect(ptr == NULL, "memalign() of a size near SIZE_MAX succeeded", size, alignment, ptr);
+			free(ptr);
+
+			ptr = aligned_alloc(alignment, size & ~(alignment - 1));
+			expect(ptr == NULL, "aligned_alloc() of a size near SIZE_MAX succeeded", size, alignment, ptr);
+			free(ptr);
+
+			ptr = NULL;
+			expect(posix_memalign(&ptr, alignment, size) == ENOMEM, "posix_memalign() of a size near SIZE_MAX did not fail with ENOMEM", size, alignment, ptr);
+			free(ptr);
+		}
+	}
+
+	void *ptr = valloc(size_max - 16);
+	expect(ptr == NULL, "valloc() of a size near SIZE_MAX succeeded", size_max - 16, 0, ptr);
+	free(ptr);
+
+	ptr = pvalloc(size_max - 16);
+	expect(ptr == NULL, "pvalloc() of a size near SIZE_MAX succeeded", size_max - 16, 0, ptr);
+	free(ptr);
+}
+
+int main()
+{
+	size_t i, alignment;
+	size_t min_alignment = _Alignof(max_align_t);
+
+#if HAVE_SIMD
+	__builtin_cpu_init();
+	have_avx = __builtin_cpu_supports("avx");
+#endif
+
+	for (i = 0; i < NUM_SIZES; i++)
+	{
+		size_t size = sizes[i];
+
+		unsigned char *ptr = check(malloc(size ? size : 1));
+		check_block(ptr, size, min_alignment, "malloc");
+
+		/* Growing and shrinking in steps that cross the alignment both ways. */
+		ptr = check(realloc(ptr, size + 40));
+		check_block(ptr, size + 40, min_alignment, "realloc");
+		ptr = check(realloc(ptr, size / 2 + 1));
+		check_block(ptr, size / 2 + 1, min_alignment, "realloc");
+		free(ptr);
+
+		ptr = check(calloc(1, size ? size : 1));
+		check_block(ptr, size, min_alignment, "calloc");
+		free(ptr);
+
+		if (size <= 65536)
+			check_usable(size ? size : 1);
+
+		for (alignment = 16; alignment <= HUGE_ALIGNMENT; alignment *= 2)
+		{
+			/* Past 4 KB only the 2 MB alignment that huge pages want. */
+			if (alignment > 4096 && alignment != HUGE_ALIGNMENT)
+				continue;
+			if (size > 65536 && alignment == HUGE_ALIGNMENT)
+				continue;
+
+			ptr = check(memalign(alignment, size));
+			check_block(ptr, size, alignment, "memalign");
+			free(ptr);
+
+			void *posix = NULL;
+			expect(posix_memalign(&posix, alignment, size) == 0, "posix_memalign() failed", size, alignment, NULL);
+			if (posix)
+			{
+				check_block(posix, size, alignment, "posix_memalign");
+				free(posix);
+			}
+
+			/* C11 wants the size to be a multiple of the alignment. */
+			size_t rounded = (size + alignment - 1) / alignment * alignment;
+			ptr = check(aligned_alloc(alignment, rounded ? rounded : alignment));
+			check_block(ptr, rounded, alignment, "aligned_alloc");
+			free(ptr);
+		}
+	}
+
+	check_invalid();
+	check_overflow();
+
+	printf("[align]: SIMD: %s\n", HAVE_SIMD ? (have_avx ? "sse avx" : "sse") : "none");
+	printf("[align]: CHECKS: %ld\n", checks);
+	printf("[align]: FAILURES: %ld\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,385 @@
+/*
+ * ast: a compiler front end's allocations.  For each translation unit it
+ * builds the syntax tree of a random program (functions made of blocks,
+ * assignments, ifs, calls and expressions), folds constant expressions,
+ * which frees subtrees and allocates literals in their place, and then
+ * destroys the whole tree.  Nodes of several sizes are allocated in bursts
+ * and freed together, lists of statements and arguments grow with
+ * realloc(), and identifier names are interned in a symbol table that
+ * lives for the whole run.
+ *
+ * Usage: tester-ast [units [functions [depth [seed]]]]
+ *
+ * functions is per unit; depth bounds how deeply statements and
+ * expressions nest.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+
+#define DEFAULT_UNITS 2000
+#define DEFAULT_FUNCTIONS 20
+#define DEFAULT_DEPTH 4
+
+#define SYMBOL_BUCKETS 4096
+#define VARIABLE_NAMES 1000
+#define FUNCTION_NAMES 200
+
+enum { NODE_LITERAL, NODE_IDENT, NODE_BINARY, NODE_CALL, NODE_ASSIGN, NODE_IF, NODE_RETURN, NODE_BLOCK, NODE_FUNCTION };
+
+typedef struct _node_t
+{
+	int kind;
+} node_t;
+
+typedef struct _literal_t
+{
+	node_t base;
+	long value;
+} literal_t;
+
+typedef struct _ident_t
+{
+	node_t base;
+	const char *name;
+} ident_t;
+
+typedef struct _binary_t
+{
+	node_t base;
+	char op;
+	node_t *left, *right;
+} binary_t;
+
+/* Calls and blocks keep their children in an array that grows as they are parsed. */
+typedef struct _list_t
+{
+	node_t base;
+	const char *name;
+	node_t **items;
+	int count, capacity;
+} list_t;
+
+typedef struct _assign_t
+{
+	node_t base;
+	node_t *target, *value;
+} assign_t;
+
+typedef struct _if_t
+{
+	node_t base;
+	node_t *condition, *then, *otherwise;
+} if_t;
+
+typedef struct _return_t
+{
+	node_t base;
+	node_t *value;
+} return_t;
+
+typedef struct _function_t
+{
+	node_t base;
+	const char *name;
+	node_t *body;
+} function_t;
+
+typedef struct _symbol_t
+{
+	struct _symbol_t *next;
+	char name[];
+} symbol_t;
+
+symbol_t *symbols[SYMBOL_BUCKETS];
+int max_depth = DEFAULT_DEPTH;
+long nodes_built, nodes_folded;
+volatile long sink;
+
+void *check(void *ptr)
+{
+	if (ptr == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+void *new_node(int kind, size_t size)
+{
+	node_t *node = check(malloc(size));
+	node->kind = kind;
+	nodes_built++;
+	return node;
+}
+
+const char *intern(const char *name)
+{
+	unsigned long hash = 5381;
+	const char *c;
+
+	for (c = name; *c; c++)
+		hash = hash * 33 + (unsigned char)*c;
+
+	symbol_t **link = &symbols[hash % SYMBOL_BUCKETS];
+	for (; *link; link = &(*link)->next)
+		if (strcmp((*link)->name, name) == 0)
+			return (*link)->name;
+
+	*link = check(malloc(sizeof(symbol_t) + strlen(name) + 1));
+	(*link)->next = NULL;
+	strcpy((*link)->name, name);
+	return (*link)->name;
+}
+
+const char *random_name(const char *prefix, int choices)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%s_%d", prefix, (int)(rng_next() % choices));
+	return intern(name);
+}
+
+list_t *new_list(int kind, const char *name)
+{
+	list_t *list = new_node(kind, sizeof(list_t));
+	list->name = name;
+	list->items = NULL;
+	list->count = list->capacity = 0;
+	return list;
+}
+
+void append(list_t *list, node_t *item)
+{
+	if (list->count == list->capacity)
+	{
+		list->capacity = list->capacity ? list->capacity * 2 : 2;
+		list->items = check(realloc(list->items, list->capacity * sizeof(node_t *)));
+	}
+	list->items[list->count++] = item;
+}
+
+node_t *expression(int depth)
+{
+	int roll = rng_next() % 10;
+
+	if (depth == 0 || roll < 3)
+	{
+		if (rng_next() % 2)
+		{
+			literal_t *literal = new_node(NODE_LITERAL, sizeof(literal_t));
+			literal->value = rng_next() % 1000;
+			return &literal->base;
+		}
+
+		ident_t *ident = new_node(NODE_IDENT, sizeof(ident_t));
+		ident->name = random_name("var", VARIABLE_NAMES);
+		return &ident->base;
+	}
+
+	if (roll < 8)
+	{
+		binary_t *binary = new_node(NODE_BINARY, sizeof(binary_t));
+		binary->op = "+-*"[rng_next() % 3];
+		binary->left = expression(depth - 1);
+		binary->right = expression(depth - 1);
+		return &binary->base;
+	}
+
+	int i, args = rng_next() % 5;
+	list_t *call = new_list(NODE_CALL, random_name("fn", FUNCTION_NAMES));
+	for (i = 0; i < args; i++)
+		append(call, expression(depth - 1));
+	return &call->base;
+}
+
+node_t *block(int depth);
+
+node_t *statement(int depth)
+{
+	int roll = rng_next() % 10;
+
+	if (roll < 5)
+	{
+		assign_t *assign = new_node(NODE_ASSIGN, sizeof(assign_t));
+		ident_t *target = new_node(NODE_IDENT, sizeof(ident_t));
+		target->name = random_name("var", VARIABLE_NAMES);
+		assign->target = &target->base;
+		assign->value = expression(depth);
+		return &assign->base;
+	}
+
+	if (roll < 7 || depth == 0)
+	{
+		list_t *call = new_list(NODE_CALL, random_name("fn", FUNCTION_NAMES));
+		append(call, expression(depth));
+		return &call->base;
+	}
+
+	if (roll < 9)
+	{
+		if_t *branch = new_node(NODE_IF, sizeof(if_t));
+		branch->condition = expression(depth - 1);
+		branch->then = block(depth - 1);
+		branch->otherwise = rng_next() % 2 ? block(depth - 1) : NULL;
+		return &branch->base;
+	}
+
+	return_t *ret = new_node(NODE_RETURN, sizeof(return_t));
+	ret->value = expression(depth);
+	return &ret->base;
+}
+
+node_t *block(int depth)
+{
+	int i, statements = 1 + rng_next() % 8;
+	list_t *list = new_list(NODE_BLOCK, NULL);
+
+	for (i = 0; i < statements; i++)
+		append(list, statement(depth));
+	return &list->base;
+}
+
+void destroy(node_t *node)
+{
+	int i;
+
+	if (!node)
+		return;
+
+	switch (node->kind)
+	{
+		case NODE_BINARY:
+			destroy(((binary_t *)node)->left);
+			destroy(((binary_t *)node)->right);
+			break;
+		case NODE_CALL:
+		case NODE_BLOCK:
+			for (i = 0; i < ((list_t *)node)->count; i++)
+				destroy(((list_t *)node)->items[i]);
+			free(((list_t *)node)->items);
+			break;
+		case NODE_ASSIGN:
+			destroy(((assign_t *)node)->target);
+			destroy(((assign_t *)node)->value);
+			break;
+		case NODE_IF:
+			destroy(((if_t *)node)->condition);
+			destroy(((if_t *)node)->then);
+			destroy(((if_t *)node)->otherwise);
+			break;
+		case NODE_RETURN:
+			destroy(((return_t *)node)->value);
+			break;
+		case NODE_FUNCTION:
+			destroy(((function_t *)node)->body);
+			break;
+	}
+
+	free(node);
+}
+
+/* Returns the node to use in place of node, which may be a new literal. */
+node_t *fold(node_t *node)
+{
+	int i;
+
+	if (!node)
+		return NULL;
+
+	switch (node->kind)
+	{
+		case NODE_BINARY:
+		{
+			binary_t *binary = (binary_t *)node;
+			binary->left = fold(binary->left);
+			binary->right = fold(binary->right);
+			if (binary->left->kind != NODE_LITERAL || binary->right->kind != NODE_LITERAL)
+				break;
+
+			long a = ((literal_t *)binary->left)->value, b = ((literal_t *)binary->right)->value;
+			literal_t *literal = new_node(NODE_LITERAL, sizeof(literal_t));
+			literal->value = binary->op == '+' ? a + b : binary->op == '-' ? a - b : a * b;
+			destroy(node);
+			nodes_folded++;
+			return &literal->base;
+		}
+		case NODE_CALL:
+		case NODE_BLOCK:
+			for (i = 0; i < ((list_t *)node)->count; i++)
+				((list_t *)node)->items[i] = fold(((list_t *)node)->items[i]);
+			break;
+		case NODE_ASSIGN:
+			((assign_t *)node)->value = fold(((assign_t *)node)->value);
+			break;
+		case NODE_IF:
+			((if_t *)node)->condition = fold(((if_t *)node)->condition);
+			((if_t *)node)->then = fold(((if_t *)node)->then);
+			((if_t *)node)->otherwise = fold(((if_t *)node)->otherwise);
+			break;
+		case NODE_RETURN:
+			((return_t *)node)->value = fold(((return_t *)node)->value);
+			break;
+		case NODE_FUNCTION:
+			((function_t *)node)->body = fold(((function_t *)node)->body);
+			break;
+	}
+
+	return node;
+}
+
+int main(int argc, char **argv)
+{
+	int i, unit, units = DEFAULT_UNITS, functions = DEFAULT_FUNCTIONS;
+
+	if (argc > 1) units = atoi(argv[1]);
+	if (argc > 2) functions = atoi(argv[2]);
+	if (argc > 3) max_depth = atoi(argv[3]);
+	if (argc > 4) rng_state = strtoull(argv[4], NULL, 0) | 1;
+
+	if (units < 1 || functions < 1 || max_depth < 1)
+	{
+		printf("Usage: %s [units [functions [depth [seed]]]]\n", argv[0]);
+		return 1;
+	}
+
+	double start = now();
+
+	for (unit = 0; unit < units; unit++)
+	{
+		list_t *tree = new_list(NODE_BLOCK, NULL);
+
+		for (i = 0; i < functions; i++)
+		{
+			function_t *function = new_node(NODE_FUNCTION, sizeof(function_t));
+			function->name = random_name("fn", FUNCTION_NAMES);
+			function->body = block(max_depth);
+			append(tree, &function->base);
+		}
+
+		fold(&tree->base);
+		sink += tree->count;
+		destroy(&tree->base);
+	}
+
+	double elapsed = now() - start;
+
+	printf("[ast]: UNITS: %d\n", units);
+	printf("[ast]: NODES: %ld\n", nodes_built);
+	printf("[ast]: FOLDED: %ld\n", nodes_folded);
+	printf("[ast]: WALL: %f\n", elapsed);
+	printf("[ast]: NODES_PER_SECOND: %.0f\n", nodes_built / elapsed);
+
+	for (i = 0; i < SYMBOL_BUCKETS; i++)
+	{
+		while (symbols[i])
+		{
+			symbol_t *next = symbols[i]->next;
+			free(symbols[i]);
+			symbols[i] = next;
+		}
+	}
+	return 0;
+}
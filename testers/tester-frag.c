@@ -0,0 +1,196 @@
+/*
+ * frag: patterns built to fragment the heap, in the spirit of Robson's
+ * worst cases.  Each one keeps the live bytes near a budget while freeing
+ * blocks in a way that leaves holes the next requests cannot use:
+ *
+ *   alternating  small and big blocks allocated in turn, then every big one
+ *                freed; the next round's big blocks are bigger, so they do
+ *                not fit the holes while the small ones sit between them
+ *   sawtooth     the live bytes ramp up with blocks of growing size and all
+ *                of them are freed; every ramp starts bigger than the last
+ *   pins         runs of blocks, each followed by a small pin that lives to
+ *                the end; the runs are freed and the next round's blocks are
+ *                bigger than a whole run, so only splitting reuses the space
+ *
+ * Usage: tester-frag [pattern [live-bytes [rounds]]]
+ *
+ * Runs one pattern (alternating by default) and reports the heap extent, the
+ * peak live bytes and their ratio: 1 is perfect, and the higher it is the
+ * more of the heap is lost to fragmentation.  The extent is how far sbrk()
+ * has moved, as in mcontest's MAX, so memory mapped separately is not seen.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "common.h"
+
+#define DEFAULT_LIVE_BYTES (512UL * 1024)
+#define DEFAULT_ROUNDS 16
+
+#define SMALL_SIZE 32
+#define PIN_SIZE 16
+#define RUN_LENGTH 4
+#define PIN_LEVELS 6
+
+size_t live, peak_live;
+char *heap_start, *heap_top;
+
+void *take(size_t size)
+{
+	char *ptr = malloc(size);
+	if (ptr == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+	ptr[0] = ptr[size - 1] = (char)size;
+
+	live += size;
+	if (live > peak_live)
+		peak_live = live;
+
+	char *top = sbrk(0);
+	if (top > heap_top)
+		heap_top = top;
+	return ptr;
+}
+
+void give(void *ptr, size_t size)
+{
+	free(ptr);
+	live -= size;
+}
+
+void alternating(size_t budget, int rounds)
+{
+	int r;
+	long i, n, prev_n = 0, capacity = budget / (SMALL_SIZE + 64) + 1;
+	char **smalls = map(capacity * sizeof(char *));
+	char **prev_smalls = map(capacity * sizeof(char *));
+	char **bigs = map(capacity * sizeof(char *));
+
+	for (r = 0; r < rounds; r++)
+	{
+		size_t big = 64 * (r + 1);
+		n = budget / (SMALL_SIZE + big);
+
+		for (i = 0; i < n; i++)
+		{
+			smalls[i] = take(SMALL_SIZE);
+			bigs[i] = take(big);
+		}
+		for (i = 0; i < n; i++)
+			give(bigs[i], big);
+
+		/* The last round's small blocks go now, leaving this round's as the pins. */
+		for (i = 0; i < prev_n; i++)
+			give(prev_smalls[i], SMALL_SIZE);
+
+		char **t = prev_smalls;
+		prev_smalls = smalls;
+		smalls = t;
+		prev_n = n;
+	}
+
+	for (i = 0; i < prev_n; i++)
+		give(prev_smalls[i], SMALL_SIZE);
+}
+
+void sawtooth(size_t budget, int rounds)
+{
+	int r;
+	long i, n, capacity = budget / 16 + 1;
+	char **blocks = map(capacity * sizeof(char *));
+	size_t *sizes = map(capacity * sizeof(size_t));
+
+	for (r = 0; r < rounds; r++)
+	{
+		size_t size = 16 + 8 * r;
+
+		for (n = 0; live + size <= budget; n++)
+		{
+			sizes[n] = size;
+			blocks[n] = take(size);
+			size += 8 + r;
+		}
+		for (i = 0; i < n; i++)
+			give(blocks[i], sizes[i]);
+	}
+}
+
+void pins(size_t budget, int rounds)
+{
+	int r;
+	long i, n, prev_n = 0, pinned = 0;
+	long capacity = budget / (RUN_LENGTH * 16) + 1;
+	char **runs = map(capacity * RUN_LENGTH * sizeof(char *));
+	char **pin_blocks = map(rounds * capacity * sizeof(char *));
+	size_t prev_size = 0;
+
+	for (r = 0; r < rounds; r++)
+	{
+		/* Each level's blocks are a little bigger than a whole run of the last. */
+		int level;
+		size_t size = 16;
+		for (level = 0; level < r % PIN_LEVELS; level++)
+			size = size * RUN_LENGTH + 16;
+
+		for (i = 0; i < prev_n * RUN_LENGTH; i++)
+			give(runs[i], prev_size);
+
+		n = budget / (RUN_LENGTH * size);
+		for (i = 0; i < n; i++)
+		{
+			int j;
+			for (j = 0; j < RUN_LENGTH; j++)
+				runs[i * RUN_LENGTH + j] = take(size);
+			pin_blocks[pinned++] = take(PIN_SIZE);
+		}
+
+		prev_n = n;
+		prev_size = size;
+	}
+
+	for (i = 0; i < prev_n * RUN_LENGTH; i++)
+		give(runs[i], prev_size);
+	for (i = 0; i < pinned; i++)
+		give(pin_blocks[i], PIN_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+	const char *pattern = "alternating";
+	size_t budget = DEFAULT_LIVE_BYTES;
+	int rounds = DEFAULT_ROUNDS;
+
+	if (argc > 1) pattern = argv[1];
+	if (argc > 2) budget = strtoul(argv[2], NULL, 0);
+	if (argc > 3) rounds = atoi(argv[3]);
+
+	void (*run)(size_t, int) = NULL;
+	if (strcmp(pattern, "alternating") == 0)
+		run = alternating;
+	else if (strcmp(pattern, "sawtooth") == 0)
+		run = sawtooth;
+	else if (strcmp(pattern, "pins") == 0)
+		run = pins;
+
+	if (run == NULL || budget < 4096 || rounds < 1)
+	{
+		printf("Usage: %s [alternating | sawtooth | pins [live-bytes [rounds]]]\n", argv[0]);
+		return 1;
+	}
+
+	printf("[frag]: PATTERN: %s\n", pattern);
+	heap_start = heap_top = heap_mark();
+
+	run(budget, rounds);
+
+	printf("[frag]: PEAK_LIVE: %zu\n", peak_live);
+	printf("[frag]: HEAP_EXTENT: %zu\n", (size_t)(heap_top - heap_start));
+	printf("[frag]: RATIO: %.2f\n", (double)(heap_top - heap_start) / peak_live);
+	return 0;
+}
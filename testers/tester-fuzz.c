@@ -0,0 +1,273 @@
+/*
+ * fuzz: drives the allocator with sequences of operations and checks every
+ * result against a shadow model of what the heap should hold.  Each live
+ * block is filled with a pattern of its own; the model catches a block
+ * whose contents change behind the program's back, one that overlaps
+ * another live block, a realloc() that loses data, calloc() memory that
+ * is not zero, a block not aligned as promised, and a usable size smaller
+ * than the request.  The first failure is printed and the program
+ * aborts, so fuzzers see it as a crash.
+ *
+ * A sequence is a string of bytes, decoded into operations on a small
+ * set of slots.  The bytes come from one of three places:
+ *
+ *   tester-fuzz [sequences [length [seed]]]
+ *       random sequences, for a quick run under mreplace or mcontest
+ *   tester-fuzz -i file
+ *       one sequence read from a file, or from stdin if file is -; for AFL:
+ *       afl-fuzz -i seeds -o findings -- ./mreplace ./tester-fuzz -i @@
+ *   LLVMFuzzerTestOneInput()
+ *       built with -DFUZZ_LIBFUZZER and linked with the allocator and
+ *       libFuzzer instead of main():
+ *       clang -fsanitize=fuzzer -DFUZZ_LIBFUZZER testers/tester-fuzz.c alloc.c -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <malloc.h>
+#include "common.h"
+
+#define SLOTS 64
+#define CHECK_EVERY 1024
+
+#define DEFAULT_SEQUENCES 20
+#define DEFAULT_LENGTH 5000
+#define MAX_INPUT (1024 * 1024)
+
+enum { OP_MALLOC, OP_CALLOC, OP_REALLOC, OP_MEMALIGN, OP_FREE, OP_CHECK, OP_TYPES };
+
+typedef struct _slot_t
+{
+	unsigned char *ptr;
+	size_t size;
+	unsigned char tag;
+} slot_t;
+
+slot_t slots[SLOTS];
+unsigned char next_tag;
+long ops_run;
+
+unsigned char pattern(unsigned char tag, size_t i)
+{
+	return (unsigned char)(tag + i * 31 + (i >> 8));
+}
+
+void fail(const char *what, int slot)
+{
+	printf("[fuzz]: FAILED: %s (slot %d, op %ld)\n", what, slot, ops_run);
+	fflush(stdout);
+	abort();
+}
+
+void fill(int slot, size_t from)
+{
+	size_t i;
+
+	for (i = from; i < slots[slot].size; i++)
+		slots[slot].ptr[i] = pattern(slots[slot].tag, i);
+}
+
+void check_contents(int slot, size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++)
+		if (slots[slot].ptr[i] != pattern(slots[slot].tag, i))
+			fail("block contents changed", slot);
+}
+
+/*
+ * A new block must be aligned for any type, usable for its whole size and
+ * must not touch any other live block.
+ */
+void check_new(int slot)
+{
+	int i;
+	unsigned char *start = slots[slot].ptr, *end = start + slots[slot].size;
+
+	if ((uintptr_t)start % _Alignof(max_align_t) != 0)
+		fail("block not aligned for any type", slot);
+
+	if (slots[slot].size > 0 && malloc_usable_size(start) < slots[slot].size)
+		fail("usable size smaller than requested", slot);
+
+	for (i = 0; i < SLOTS; i++)
+	{
+		if (i == slot || !slots[i].ptr)
+			continue;
+		if (start == slots[i].ptr)
+			fail("same address as another live block", slot);
+		if (start < slots[i].ptr + slots[i].size && slots[i].ptr < end)
+			fail("overlaps another live block", slot);
+	}
+}
+
+/* Sizes run from 0 to 128 KB, most of them small. */
+size_t decode_size(unsigned char a, unsigned char b)
+{
+	return ((size_t)(b + 1) << (a % 12)) >> 2;
+}
+
+void release(int slot)
+{
+	if (!slots[slot].ptr)
+		return;
+	check_contents(slot, slots[slot].size);
+	free(slots[slot].ptr);
+	slots[slot].ptr = NULL;
+	slots[slot].size = 0;
+}
+
+void run(const unsigned char *data, size_t length)
+{
+	size_t pos = 0;
+	int i;
+
+	while (pos + 4 <= length)
+	{
+		int op = data[pos] % OP_TYPES;
+		int slot = data[pos + 1] % SLOTS;
+		size_t size = decode_size(data[pos + 2], data[pos + 3]);
+		unsigned char *ptr;
+		pos += 4;
+		ops_run++;
+
+		switch (op)
+		{
+			case OP_MALLOC:
+			case OP_CALLOC:
+				release(slot);
+				ptr = op == OP_MALLOC ? malloc(size) : calloc(1, size);
+				if (!ptr)
+					break;
+				if (op == OP_CALLOC)
+					for (i = 0; i < (int)size; i++)
+						if (ptr[i] != 0)
+							fail("calloc() memory not zeroed", slot);
+
+				slots[slot].ptr = ptr;
+				slots[slot].size = size;
+				slots[slot].tag = next_tag++;
+				check_new(slot);
+				fill(slot, 0);
+				break;
+
+			case OP_REALLOC:
+			{
+				if (!slots[slot].ptr)
+					slots[slot].tag = next_tag++;
+				size_t old_size = slots[slot].size;
+
+				/* realloc(ptr, 0) may free the block and return NULL; keep it simple and skip it. */
+				if (size == 0)
+					break;
+				ptr = realloc(slots[slot].ptr, size);
+				if (!ptr)
+					break;
+
+				slots[slot].ptr = ptr;
+				slots[slot].size = size;
+				check_contents(slot, old_size < size ? old_size : size);
+				check_new(slot);
+				fill(slot, old_size < size ? old_size : size);
+				break;
+			}
+
+			case OP_MEMALIGN:
+			{
+				size_t alignment = (size_t)8 << (data[pos - 2] >> 4 & 7);
+				release(slot);
+				ptr = memalign(alignment, size);
+				if (!ptr)
+					break;
+				if ((uintptr_t)ptr % alignment != 0)
+					fail("memalign() block not aligned", slot);
+
+				slots[slot].ptr = ptr;
+				slots[slot].size = size;
+				slots[slot].tag = next_tag++;
+				check_new(slot);
+				fill(slot, 0);
+				break;
+			}
+
+			case OP_FREE:
+				release(slot);
+				break;
+
+			case OP_CHECK:
+				if (slots[slot].ptr)
+					check_contents(slot, slots[slot].size);
+				break;
+		}
+
+		/* Every so often, every live block, to catch damage to blocks not touched for a while. */
+		if (ops_run % CHECK_EVERY == 0)
+			for (i = 0; i < SLOTS; i++)
+				if (slots[i].ptr)
+					check_contents(i, slots[i].size);
+	}
+
+	for (i = 0; i < SLOTS; i++)
+		release(i);
+}
+
+#ifdef FUZZ_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	run(data, size);
+	return 0;
+}
+#else
+int main(int argc, char **argv)
+{
+	long i, j, sequences = DEFAULT_SEQUENCES, length = DEFAULT_LENGTH;
+
+	if (argc > 2 && strcmp(argv[1], "-i") == 0)
+	{
+		FILE *input = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "rb");
+		if (!input)
+		{
+			perror(argv[2]);
+			return 1;
+		}
+
+		/* Read into a buffer of its own, so the input is not a block in the heap under test. */
+		static unsigned char data[MAX_INPUT];
+		size_t size = fread(data, 1, MAX_INPUT, input);
+		if (input != stdin)
+			fclose(input);
+
+		run(data, size);
+		printf("[fuzz]: OPS: %ld\n", ops_run);
+		printf("[fuzz]: STATUS: OK\n");
+		return 0;
+	}
+
+	if (argc > 1) sequences = atol(argv[1]);
+	if (argc > 2) length = atol(argv[2]);
+	if (argc > 3) rng_state = strtoull(argv[3], NULL, 0) | 1;
+
+	if (sequences < 1 || length < 1 || length > MAX_INPUT / 4)
+	{
+		printf("Usage: %s [sequences [length [seed]]]\n", argv[0]);
+		printf("       %s -i file\n", argv[0]);
+		return 1;
+	}
+
+	static unsigned char data[MAX_INPUT];
+	for (i = 0; i < sequences; i++)
+	{
+		for (j = 0; j < length * 4; j++)
+			data[j] = rng_next() >> 32;
+		run(data, length * 4);
+	}
+
+	printf("[fuzz]: SEQUENCES: %ld\n", sequences);
+	printf("[fuzz]: OPS: %ld\n", ops_run);
+	printf("[fuzz]: STATUS: OK\n");
+	return 0;
+}
+#endif
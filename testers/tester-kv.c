@@ -0,0 +1,242 @@
+/*
+ * kv: an in-memory key-value store, like a cache server.  Keys are short
+ * strings and values vary from a few bytes to kilobytes; a mix of gets,
+ * sets and deletes runs against it, with a few keys much hotter than the
+ * rest.  The table doubles its bucket array as it fills, and a set that
+ * replaces a value reallocates it.
+ *
+ * Usage: tester-kv [operations [keys [get-percent [set-percent [seed]]]]]
+ *
+ * What is left over after gets and sets are deletes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common.h"
+
+#define DEFAULT_OPERATIONS 500000
+#define DEFAULT_KEYS 100000
+#define DEFAULT_GET_PERCENT 80
+#define DEFAULT_SET_PERCENT 15
+
+#define INITIAL_BUCKETS 1024
+#define KEY_LENGTH 48
+
+typedef struct _entry_t
+{
+	struct _entry_t *next;
+	unsigned long hash;
+	char *key;
+	char *value;
+	size_t value_size;
+} entry_t;
+
+typedef struct _table_t
+{
+	entry_t **buckets;
+	unsigned long num_buckets;
+	unsigned long count;
+} table_t;
+
+volatile long sink;
+
+void *check(void *ptr)
+{
+	if (ptr == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+/* FNV-1a. */
+unsigned long hash_key(const char *key)
+{
+	unsigned long hash = 14695981039346656037UL;
+
+	for (; *key; key++)
+		hash = (hash ^ (unsigned char)*key) * 1099511628211UL;
+	return hash;
+}
+
+/* Most values are small, one in sixteen is up to 16 KB. */
+size_t value_size()
+{
+	if (rng_next() % 16 == 0)
+		return 1024 + rng_next() % (15 * 1024);
+	return 8 + rng_next() % 504;
+}
+
+void fill(char *value, size_t size)
+{
+	memset(value, 'a' + size % 26, size);
+}
+
+entry_t **find(table_t *table, const char *key, unsigned long hash)
+{
+	entry_t **link = &table->buckets[hash & (table->num_buckets - 1)];
+
+	while (*link && ((*link)->hash != hash || strcmp((*link)->key, key) != 0))
+		link = &(*link)->next;
+	return link;
+}
+
+void grow(table_t *table)
+{
+	unsigned long i, num_buckets = table->num_buckets * 2;
+	entry_t **buckets = check(calloc(num_buckets, sizeof(entry_t *)));
+
+	for (i = 0; i < table->num_buckets; i++)
+	{
+		entry_t *entry = table->buckets[i];
+		while (entry)
+		{
+			entry_t *next = entry->next;
+			entry->next = buckets[entry->hash & (num_buckets - 1)];
+			buckets[entry->hash & (num_buckets - 1)] = entry;
+			entry = next;
+		}
+	}
+
+	free(table->buckets);
+	table->buckets = buckets;
+	table->num_buckets = num_buckets;
+}
+
+void set(table_t *table, const char *key, size_t size)
+{
+	unsigned long hash = hash_key(key);
+	entry_t **link = find(table, key, hash);
+	entry_t *entry = *link;
+
+	if (entry)
+	{
+		entry->value = check(realloc(entry->value, size));
+		entry->value_size = size;
+		fill(entry->value, size);
+		return;
+	}
+
+	entry = check(malloc(sizeof(entry_t)));
+	entry->hash = hash;
+	entry->key = check(malloc(strlen(key) + 1));
+	strcpy(entry->key, key);
+	entry->value = check(malloc(size));
+	entry->value_size = size;
+	fill(entry->value, size);
+	entry->next = NULL;
+	*link = entry;
+
+	if (++table->count > table->num_buckets)
+		grow(table);
+}
+
+const char *get(table_t *table, const char *key)
+{
+	entry_t *entry = *find(table, key, hash_key(key));
+	return entry ? entry->value : NULL;
+}
+
+void delete(table_t *table, const char *key)
+{
+	entry_t **link = find(table, key, hash_key(key));
+	entry_t *entry = *link;
+
+	if (!entry)
+		return;
+
+	*link = entry->next;
+	free(entry->key);
+	free(entry->value);
+	free(entry);
+	table->count--;
+}
+
+int main(int argc, char **argv)
+{
+	long i, operations = DEFAULT_OPERATIONS, keys = DEFAULT_KEYS;
+	int get_percent = DEFAULT_GET_PERCENT, set_percent = DEFAULT_SET_PERCENT;
+	char key[KEY_LENGTH];
+
+	if (argc > 1) operations = atol(argv[1]);
+	if (argc > 2) keys = atol(argv[2]);
+	if (argc > 3) get_percent = atoi(argv[3]);
+	if (argc > 4) set_percent = atoi(argv[4]);
+	if (argc > 5) rng_state = strtoull(argv[5], NULL, 0) | 1;
+
+	if (operations < 0 || keys < 1 || get_percent < 0 || set_percent < 0 || get_percent + set_percent > 100)
+	{
+		printf("Usage: %s [operations [keys [get-percent [set-percent [seed]]]]]\n", argv[0]);
+		return 1;
+	}
+
+	table_t table;
+	table.num_buckets = INITIAL_BUCKETS;
+	table.buckets = check(calloc(table.num_buckets, sizeof(entry_t *)));
+	table.count = 0;
+
+	/* Half the keys are there before the mix starts, as in a warm cache. */
+	for (i = 0; i < keys; i += 2)
+	{
+		snprintf(key, sizeof(key), "user:%ld:session", i);
+		set(&table, key, value_size());
+	}
+
+	long gets = 0, hits = 0, sets = 0, deletes = 0;
+	double start = now();
+
+	for (i = 0; i < operations; i++)
+	{
+		/* Squaring a uniform draw makes low-numbered keys the hot ones. */
+		double u = (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+		snprintf(key, sizeof(key), "user:%ld:session", (long)(u * u * keys));
+
+		int roll = rng_next() % 100;
+		if (roll < get_percent)
+		{
+			const char *value = get(&table, key);
+			gets++;
+			if (value)
+			{
+				sink += value[0];
+				hits++;
+			}
+		}
+		else if (roll < get_percent + set_percent)
+		{
+			set(&table, key, value_size());
+			sets++;
+		}
+		else
+		{
+			delete(&table, key);
+			deletes++;
+		}
+	}
+
+	double elapsed = now() - start;
+
+	printf("[kv]: GETS: %ld\n", gets);
+	printf("[kv]: HIT_RATE: %.3f\n", gets ? (double)hits / gets : 0.0);
+	printf("[kv]: SETS: %ld\n", sets);
+	printf("[kv]: DELETES: %ld\n", deletes);
+	printf("[kv]: ENTRIES: %lu\n", table.count);
+	printf("[kv]: WALL: %f\n", elapsed);
+	printf("[kv]: OPS_PER_SECOND: %.0f\n", operations / elapsed);
+
+	for (i = 0; i < (long)table.num_buckets; i++)
+	{
+		while (table.buckets[i])
+		{
+			entry_t *next = table.buckets[i]->next;
+			free(table.buckets[i]->key);
+			free(table.buckets[i]->value);
+			free(table.buckets[i]);
+			table.buckets[i] = next;
+		}
+	}
+	free(table.buckets);
+	return 0;
+}
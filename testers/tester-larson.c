@@ -0,0 +1,123 @@
+/*
+ * larson: a server-style workload.  Every thread owns a set of slots and
+ * keeps replacing a random one: free the block in it, allocate a new one of
+ * random size.  After every round its slots are handed to a new thread, so
+ * blocks are mostly freed by a different thread from the one that allocated
+ * them, as when connections move between worker threads.  (After the
+ * benchmark by Larson and Krishnan.)
+ *
+ * Usage: tester-larson [threads [rounds [slots [operations [min-size [max-size]]]]]]
+ *
+ * slots and operations are per thread and per round.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "common.h"
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_ROUNDS 20
+#define DEFAULT_SLOTS 1000
+#define DEFAULT_OPERATIONS 20000
+#define DEFAULT_MIN_SIZE 16
+#define DEFAULT_MAX_SIZE 512
+
+typedef struct _slots_t
+{
+	char **blocks;
+	unsigned int seed;
+} slots_t;
+
+int num_slots = DEFAULT_SLOTS;
+int operations = DEFAULT_OPERATIONS;
+int min_size = DEFAULT_MIN_SIZE;
+int max_size = DEFAULT_MAX_SIZE;
+
+char *allocate(unsigned int *seed)
+{
+	int size = min_size + rand_r(seed) % (max_size - min_size + 1);
+	char *block = malloc(size);
+
+	if (block == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+
+	block[0] = block[size - 1] = (char)size;
+	return block;
+}
+
+void *worker(void *arg)
+{
+	int i;
+	slots_t *slots = arg;
+
+	for (i = 0; i < operations; i++)
+	{
+		int victim = rand_r(&slots->seed) % num_slots;
+		free(slots->blocks[victim]);
+		slots->blocks[victim] = allocate(&slots->seed);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int i, j, round, threads = DEFAULT_THREADS, rounds = DEFAULT_ROUNDS;
+
+	if (argc > 1) threads = atoi(argv[1]);
+	if (argc > 2) rounds = atoi(argv[2]);
+	if (argc > 3) num_slots = atoi(argv[3]);
+	if (argc > 4) operations = atoi(argv[4]);
+	if (argc > 5) min_size = atoi(argv[5]);
+	if (argc > 6) max_size = atoi(argv[6]);
+
+	if (threads < 1 || rounds < 1 || num_slots < 1 || operations < 0 || min_size < 1 || max_size < min_size)
+	{
+		printf("Usage: %s [threads [rounds [slots [operations [min-size [max-size]]]]]]\n", argv[0]);
+		return 1;
+	}
+
+	/* The main thread fills every slot, so even the first round frees remotely. */
+	slots_t *slots = malloc(threads * sizeof(slots_t));
+	for (i = 0; i < threads; i++)
+	{
+		slots[i].seed = i + 1;
+		slots[i].blocks = malloc(num_slots * sizeof(char *));
+		for (j = 0; j < num_slots; j++)
+			slots[i].blocks[j] = allocate(&slots[i].seed);
+	}
+
+	pthread_t *ids = malloc(threads * sizeof(pthread_t));
+
+	double start = now();
+	for (round = 0; round < rounds; round++)
+	{
+		/* Each round's threads take over the slots in a different order. */
+		for (i = 0; i < threads; i++)
+			pthread_create(&ids[i], NULL, worker, &slots[(i + round) % threads]);
+		for (i = 0; i < threads; i++)
+			pthread_join(ids[i], NULL);
+	}
+	double elapsed = now() - start;
+
+	double ops = 2.0 * operations * threads * rounds;
+
+	printf("[larson]: THREADS: %d\n", threads);
+	printf("[larson]: OPS: %.0f\n", ops);
+	printf("[larson]: WALL: %f\n", elapsed);
+	printf("[larson]: OPS_PER_SECOND: %.0f\n", ops / elapsed);
+
+	for (i = 0; i < threads; i++)
+	{
+		for (j = 0; j < num_slots; j++)
+			free(slots[i].blocks[j]);
+		free(slots[i].blocks);
+	}
+	free(slots);
+	free(ids);
+	return 0;
+}
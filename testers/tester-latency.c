@@ -0,0 +1,322 @@
+/*
+ * latency: the cost of single calls, by size.  For every power of two from
+ * 8 bytes up to max-size it times malloc(), free(), calloc(), a realloc()
+ * that doubles a block and one that halves it, each in two cases:
+ *
+ *   hot     the same call over and over on one block, so the allocator's
+ *           data is in cache and its fast path is taken
+ *   cold    a working set of blocks, allocated together and then freed or
+ *           resized in random order, with the caches swept before every
+ *           call so neither the blocks nor the allocator's data are in them
+ *
+ * Usage: tester-latency [max-size [samples [seed [evict-bytes]]]]
+ *
+ * Calls are timed with rdtsc behind lfence, which stops it running ahead
+ * of or behind the call, in cycles; on other processors with the
+ * monotonic clock, in ns.  The cost of reading the timer is taken off.
+ * The sweep reads a buffer of twice the last-level cache, but no more than
+ * EVICT_MAX unless evict-bytes says otherwise: some machines report caches
+ * of hundreds of megabytes, and sweeping that before every call takes
+ * longer than mcontest allows.
+ * Every line of output is a JSON object: first the timer, then one per
+ * call, case and size with the minimum, percentiles and maximum.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "common.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+#define TIMER_UNIT "cycles"
+
+static inline unsigned long long timer()
+{
+	_mm_lfence();
+	unsigned long long t = __rdtsc();
+	_mm_lfence();
+	return t;
+}
+#else
+#define TIMER_UNIT "ns"
+
+static inline unsigned long long timer()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+#define MIN_SIZE 8
+#define DEFAULT_MAX_SIZE (64UL * 1024 * 1024)
+#define DEFAULT_SAMPLES 2000
+
+/*
+ * The cold case keeps at most this many blocks, and this much memory,
+ * allocated at once, and times each call on them once.  It is the sweep
+ * before every call that makes them cold, so the count only has to be
+ * enough for percentiles.
+ */
+#define COLD_SAMPLES 32
+#define WORKING_SET (64UL * 1024 * 1024)
+
+#define DEFAULT_LLC_SIZE (8UL * 1024 * 1024)
+#define EVICT_MAX (64UL * 1024 * 1024)
+#define CACHE_LINE 64
+
+unsigned long long overhead;
+
+unsigned char *evict_buffer;
+size_t evict_size;
+volatile unsigned long evict_sink;
+
+/* Reads a line of every cache line's worth of the buffer, pushing everything else out. */
+void evict()
+{
+	size_t i;
+	unsigned long sum = 0;
+
+	for (i = 0; i < evict_size; i += CACHE_LINE)
+		sum += evict_buffer[i];
+	evict_sink = sum;
+}
+
+void shuffle(long *order, long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	for (i = n - 1; i > 0; i--)
+	{
+		long j = rng_next() % (i + 1);
+		long t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+}
+
+void *check(void *ptr)
+{
+	if (ptr == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+int compare(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+	return x < y ? -1 : x > y;
+}
+
+void report(const char *call, const char *mode, size_t size, unsigned long long *samples, long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		samples[i] = samples[i] > overhead ? samples[i] - overhead : 0;
+	qsort(samples, n, sizeof(unsigned long long), compare);
+
+	printf("{\"call\": \"%s\", \"case\": \"%s\", \"size\": %zu, \"n\": %ld, "
+	       "\"min\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu}\n",
+	       call, mode, size, n, samples[0], samples[n / 2], samples[n * 9 / 10], samples[n * 99 / 100], samples[n - 1]);
+}
+
+/* Reading the timer back to back costs this much; it comes off every sample. */
+void calibrate()
+{
+	int i;
+
+	overhead = ~0ULL;
+	for (i = 0; i < 10000; i++)
+	{
+		unsigned long long start = timer();
+		unsigned long long elapsed = timer() - start;
+		if (elapsed < overhead)
+			overhead = elapsed;
+	}
+}
+
+void hot(size_t size, long n, unsigned long long *mallocs, unsigned long long *frees, unsigned long long *pairs,
+         unsigned long long *callocs, unsigned long long *grows, unsigned long long *shrinks)
+{
+	long i;
+	unsigned long long start, middle, end;
+
+	for (i = 0; i < n; i++)
+	{
+		start = timer();
+		void *ptr = check(malloc(size));
+		middle = timer();
+		free(ptr);
+		end = timer();
+
+		mallocs[i] = middle - start;
+		frees[i] = end - middle;
+		pairs[i] = mallocs[i] + frees[i];
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		start = timer();
+		void *ptr = check(calloc(1, size));
+		callocs[i] = timer() - start;
+		free(ptr);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		void *ptr = check(malloc(size));
+		start = timer();
+		ptr = check(realloc(ptr, size * 2));
+		grows[i] = timer() - start;
+		free(ptr);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		void *ptr = check(malloc(size));
+		start = timer();
+		ptr = check(realloc(ptr, size / 2));
+		shrinks[i] = timer() - start;
+		free(ptr);
+	}
+}
+
+void cold(size_t size, long n, void **blocks, long *order, unsigned long long *mallocs, unsigned long long *frees,
+                  unsigned long long *pairs, unsigned long long *callocs, unsigned long long *grows, unsigned long long *shrinks)
+{
+	long i;
+	unsigned long long start;
+
+	for (i = 0; i < n; i++)
+	{
+		evict();
+		start = timer();
+		blocks[i] = check(malloc(size));
+		mallocs[i] = timer() - start;
+	}
+
+	shuffle(order, n);
+	for (i = 0; i < n; i++)
+	{
+		evict();
+		start = timer();
+		free(blocks[order[i]]);
+		frees[i] = timer() - start;
+		pairs[i] = mallocs[order[i]] + frees[i];
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		evict();
+		start = timer();
+		blocks[i] = check(calloc(1, size));
+		callocs[i] = timer() - start;
+	}
+	shuffle(order, n);
+	for (i = 0; i < n; i++)
+		free(blocks[order[i]]);
+
+	for (i = 0; i < n; i++)
+		blocks[i] = check(malloc(size));
+	shuffle(order, n);
+	for (i = 0; i < n; i++)
+	{
+		evict();
+		start = timer();
+		blocks[order[i]] = check(realloc(blocks[order[i]], size * 2));
+		grows[i] = timer() - start;
+	}
+	for (i = 0; i < n; i++)
+		free(blocks[i]);
+
+	for (i = 0; i < n; i++)
+		blocks[i] = check(malloc(size));
+	shuffle(order, n);
+	for (i = 0; i < n; i++)
+	{
+		evict();
+		start = timer();
+		blocks[order[i]] = check(realloc(blocks[order[i]], size / 2));
+		shrinks[i] = timer() - start;
+	}
+	for (i = 0; i < n; i++)
+		free(blocks[i]);
+}
+
+int main(int argc, char **argv)
+{
+	size_t size, max_size = DEFAULT_MAX_SIZE;
+	long samples = DEFAULT_SAMPLES;
+	int i;
+
+	if (argc > 1) max_size = strtoul(argv[1], NULL, 0);
+	if (argc > 2) samples = atol(argv[2]);
+	if (argc > 3) rng_state = strtoull(argv[3], NULL, 0) | 1;
+
+	long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	evict_size = 2 * (llc > 0 ? (size_t)llc : DEFAULT_LLC_SIZE);
+	if (evict_size > EVICT_MAX)
+		evict_size = EVICT_MAX;
+	if (argc > 4) evict_size = strtoul(argv[4], NULL, 0);
+
+	if (max_size < MIN_SIZE || samples < 1 || evict_size < CACHE_LINE)
+	{
+		printf("Usage: %s [max-size [samples [seed [evict-bytes]]]]\n", argv[0]);
+		return 1;
+	}
+
+	unsigned long long *results[6];
+	for (i = 0; i < 6; i++)
+		results[i] = map(samples * sizeof(unsigned long long));
+	void **blocks = map(samples * sizeof(void *));
+	long *order = map(samples * sizeof(long));
+
+	/* Written once so its pages are real rather than the shared zero page. */
+	evict_buffer = map(evict_size);
+	memset(evict_buffer, 1, evict_size);
+
+	calibrate();
+	printf("{\"timer\": \"%s\", \"overhead\": %llu, \"evict\": %zu}\n", TIMER_UNIT, overhead, evict_size);
+
+	const char *calls[6] = { "malloc", "free", "malloc+free", "calloc", "realloc-grow", "realloc-shrink" };
+
+	for (size = MIN_SIZE; size <= max_size; size *= 2)
+	{
+		/* Fewer samples of big blocks, so every size takes about as long. */
+		long n = samples;
+		if (size > 65536 && n > samples * 65536 / (long)size)
+			n = samples * 65536 / (long)size;
+		if (n < 16)
+			n = samples < 16 ? samples : 16;
+
+		hot(size, n, results[0], results[1], results[2], results[3], results[4], results[5]);
+		for (i = 0; i < 6; i++)
+			report(calls[i], "hot", size, results[i], n);
+
+		long working = WORKING_SET / size;
+		if (working > COLD_SAMPLES)
+			working = COLD_SAMPLES;
+		if (working > n)
+			working = n;
+		if (working < 2)
+			working = n < 2 ? n : 2;
+
+		cold(size, working, blocks, order, results[0], results[1], results[2], results[3], results[4], results[5]);
+		for (i = 0; i < 6; i++)
+			report(calls[i], "cold", size, results[i], working);
+
+		fflush(stdout);
+	}
+
+	return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * locality: how fast a program runs over what the allocator handed it.
+ * Builds a linked list, a binary tree and a hash table with chains, with
+ * other blocks of random size allocated and freed between the nodes as a
+ * real program would, then times passes over each:
+ *
+ *   LIST_ALLOC_ORDER   a list linked in the order its nodes were allocated,
+ *                      so a walk follows the allocator's placement
+ *   LIST_RANDOM_ORDER  the same nodes linked in random order, which no
+ *                      placement helps; the gap between the two is what
+ *                      placement is worth
+ *   TREE               an in-order walk of a tree built from random keys
+ *   HASH               a lookup of every key, in random order
+ *
+ * Usage: tester-locality [nodes [passes [churn [seed]]]]
+ *
+ * churn is how many other blocks are allocated and freed per node.  Times
+ * are in ns per node visited.  Where the kernel lets the program count
+ * them, cache and TLB misses per node are reported too.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "common.h"
+
+#define DEFAULT_NODES 200000
+#define DEFAULT_PASSES 10
+#define DEFAULT_CHURN 2
+
+#define JUNK_SLOTS 1024
+#define JUNK_MIN_SIZE 16
+#define JUNK_MAX_SIZE 256
+#define CHAIN_LENGTH 4
+
+typedef struct _list_node_t
+{
+	struct _list_node_t *next;
+	long value;
+	char payload[32];
+} list_node_t;
+
+typedef struct _tree_node_t
+{
+	struct _tree_node_t *left, *right;
+	long key;
+	char payload[24];
+} tree_node_t;
+
+typedef struct _hash_node_t
+{
+	struct _hash_node_t *next;
+	long key, value;
+} hash_node_t;
+
+long nodes = DEFAULT_NODES;
+int passes = DEFAULT_PASSES;
+int churn = DEFAULT_CHURN;
+
+void *junk[JUNK_SLOTS];
+volatile long sink;
+
+/* Counter descriptors, or -1 where the kernel will not count. */
+int cache_misses = -1, tlb_misses = -1;
+
+void *check(void *ptr)
+{
+	if (ptr == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+void shuffle(long *order, long n)
+{
+	long i;
+
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	for (i = n - 1; i > 0; i--)
+	{
+		long j = rng_next() % (i + 1);
+		long t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+}
+
+/* Replaces churn random blocks of junk, so the nodes are spread between them. */
+void stir()
+{
+	int i;
+
+	for (i = 0; i < churn; i++)
+	{
+		int slot = rng_next() % JUNK_SLOTS;
+		free(junk[slot]);
+		size_t size = JUNK_MIN_SIZE + rng_next() % (JUNK_MAX_SIZE - JUNK_MIN_SIZE + 1);
+		junk[slot] = check(malloc(size));
+		memset(junk[slot], 0, size);
+	}
+}
+
+int open_counter(unsigned int type, unsigned long long config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void start_counter(int fd)
+{
+	if (fd < 0)
+		return;
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+long long stop_counter(int fd)
+{
+	long long count = 0;
+
+	if (fd < 0)
+		return 0;
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fd, &count, sizeof(count)) != sizeof(count))
+		return 0;
+	return count;
+}
+
+long walk_list(list_node_t *node)
+{
+	long sum = 0;
+
+	for (; node; node = node->next)
+		sum += node->value;
+	return sum;
+}
+
+long walk_tree(tree_node_t *node)
+{
+	long sum = 0;
+
+	while (node)
+	{
+		sum += walk_tree(node->left) + node->key;
+		node = node->right;
+	}
+	return sum;
+}
+
+long look_up(hash_node_t **buckets, long num_buckets, long *keys)
+{
+	long i, sum = 0;
+
+	for (i = 0; i < nodes; i++)
+	{
+		hash_node_t *node = buckets[keys[i] % num_buckets];
+		while (node->key != keys[i])
+			node = node->next;
+		sum += node->value;
+	}
+	return sum;
+}
+
+enum { WALK_LIST, WALK_TREE, LOOK_UP };
+
+void measure(const char *name, int kind, void *root, long num_buckets, long *keys)
+{
+	int i;
+	long sum = 0;
+
+	start_counter(cache_misses);
+	start_counter(tlb_misses);
+	double start = now();
+
+	for (i = 0; i < passes; i++)
+	{
+		if (kind == WALK_LIST)
+			sum += walk_list(root);
+		else if (kind == WALK_TREE)
+			sum += walk_tree(root);
+		else
+			sum += look_up(root, num_buckets, keys);
+	}
+
+	double elapsed = now() - start;
+	long long cache = stop_counter(cache_misses);
+	long long tlb = stop_counter(tlb_misses);
+	sink = sum;
+
+	double visits = (double)nodes * passes;
+	printf("[locality]: %s_NS: %.2f\n", name, elapsed * 1e9 / visits);
+	if (cache_misses >= 0)
+		printf("[locality]: %s_CACHE_MISSES: %.3f\n", name, cache / visits);
+	if (tlb_misses >= 0)
+		printf("[locality]: %s_TLB_MISSES: %.3f\n", name, tlb / visits);
+}
+
+int main(int argc, char **argv)
+{
+	long i;
+
+	if (argc > 1) nodes = atol(argv[1]);
+	if (argc > 2) passes = atoi(argv[2]);
+	if (argc > 3) churn = atoi(argv[3]);
+	if (argc > 4) rng_state = strtoull(argv[4], NULL, 0) | 1;
+
+	if (nodes < 1 || passes < 1 || churn < 0)
+	{
+		printf("Usage: %s [nodes [passes [churn [seed]]]]\n", argv[0]);
+		return 1;
+	}
+
+	cache_misses = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	tlb_misses = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+	                          (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	if (cache_misses < 0 && tlb_misses < 0)
+		printf("[locality]: COUNTERS: unavailable\n");
+
+	long *order = map(nodes * sizeof(long));
+	long *keys = map(nodes * sizeof(long));
+	list_node_t **list_nodes = map(nodes * sizeof(list_node_t *));
+
+	/* The list: nodes allocated in one order, then linked twice. */
+	for (i = 0; i < nodes; i++)
+	{
+		list_nodes[i] = check(malloc(sizeof(list_node_t)));
+		list_nodes[i]->value = i;
+		stir();
+	}
+
+	list_node_t *list = NULL;
+	for (i = nodes - 1; i >= 0; i--)
+	{
+		list_nodes[i]->next = list;
+		list = list_nodes[i];
+	}
+	measure("LIST_ALLOC_ORDER", WALK_LIST, list, 0, NULL);
+
+	shuffle(order, nodes);
+	list = NULL;
+	for (i = 0; i < nodes; i++)
+	{
+		list_nodes[order[i]]->next = list;
+		list = list_nodes[order[i]];
+	}
+	measure("LIST_RANDOM_ORDER", WALK_LIST, list, 0, NULL);
+
+	/* The tree: random keys, so neighbours in key order were allocated far apart. */
+	shuffle(keys, nodes);
+	tree_node_t *tree = NULL;
+	for (i = 0; i < nodes; i++)
+	{
+		tree_node_t *node = check(malloc(sizeof(tree_node_t)));
+		node->left = node->right = NULL;
+		node->key = keys[i];
+
+		tree_node_t **link = &tree;
+		while (*link)
+			link = keys[i] < (*link)->key ? &(*link)->left : &(*link)->right;
+		*link = node;
+		stir();
+	}
+	measure("TREE", WALK_TREE, tree, 0, NULL);
+
+	/* The hash table: chains of about CHAIN_LENGTH nodes, pushed at the head. */
+	long num_buckets = nodes / CHAIN_LENGTH + 1;
+	hash_node_t **buckets = check(calloc(num_buckets, sizeof(hash_node_t *)));
+	for (i = 0; i < nodes; i++)
+	{
+		hash_node_t *node = check(malloc(sizeof(hash_node_t)));
+		node->key = keys[i];
+		node->value = i;
+		node->next = buckets[keys[i] % num_buckets];
+		buckets[keys[i] % num_buckets] = node;
+		stir();
+	}
+	shuffle(keys, nodes);
+	measure("HASH", LOOK_UP, buckets, num_buckets, keys);
+
+	for (i = 0; i < nodes; i++)
+		free(list_nodes[i]);
+	while (tree)
+	{
+		/* Rotate left children up until there are none, then free and go right. */
+		if (tree->left)
+		{
+			tree_node_t *left = tree->left;
+			tree->left = left->right;
+			left->right = tree;
+			tree = left;
+		}
+		else
+		{
+			tree_node_t *right = tree->right;
+			free(tree);
+			tree = right;
+		}
+	}
+	for (i = 0; i < num_buckets; i++)
+	{
+		while (buckets[i])
+		{
+			hash_node_t *next = buckets[i]->next;
+			free(buckets[i]);
+			buckets[i] = next;
+		}
+	}
+	free(buckets);
+	for (i = 0; i < JUNK_SLOTS; i++)
+		free(junk[i]);
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * logs: a log-processing pipeline, the kind of string-heavy C++ that
+ * spends its time in short-lived std::string and std::vector buffers.
+ * Batches of log lines are generated, split into fields and key=value
+ * pairs, filtered, normalised, counted per service and endpoint, and
+ * formatted back out as CSV.  Nothing reserves ahead, so the containers
+ * grow by reallocation as they would in most real code.
+ *
+ * Usage: tester-logs [lines [batch [seed]]]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "common.h"
+
+#define DEFAULT_LINES 500000
+#define DEFAULT_BATCH 1000
+
+static const char *levels[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR" };
+static const char *services[] = { "frontend", "checkout-service", "inventory", "payment-gateway", "search-indexer" };
+static const char *resources[] = { "users", "orders", "carts", "products", "sessions", "recommendations" };
+
+struct endpoint_stats
+{
+	long requests;
+	long errors;
+	long total_latency;
+};
+
+volatile size_t sink;
+
+std::string generate_line(long number)
+{
+	std::string line = "2013-04-";
+	line += std::to_string(10 + number % 20);
+	line += "T12:";
+	line += std::to_string(10 + number % 50);
+	line += ":00Z ";
+	line += levels[rng_next() % (sizeof(levels) / sizeof(levels[0]))];
+	line += ' ';
+	line += services[rng_next() % (sizeof(services) / sizeof(services[0]))];
+	line += " request_id=req-";
+	line += std::to_string(rng_next() % 100000000);
+	line += " path=/api/v1/";
+	line += resources[rng_next() % (sizeof(resources) / sizeof(resources[0]))];
+	line += '/';
+	line += std::to_string(rng_next() % 100000);
+	line += " status=";
+	line += rng_next() % 20 == 0 ? "500" : "200";
+	line += " latency_ms=";
+	line += std::to_string(rng_next() % 2000);
+
+	/* Some lines carry a free-text message long enough to leave the small string buffer. */
+	if (rng_next() % 4 == 0)
+		line += " message=upstream_connection_reset_while_reading_response_header";
+	return line;
+}
+
+std::vector<std::string> split(const std::string &line, char separator)
+{
+	std::vector<std::string> fields;
+	size_t start = 0, end;
+
+	while ((end = line.find(separator, start)) != std::string::npos)
+	{
+		fields.push_back(line.substr(start, end - start));
+		start = end + 1;
+	}
+	fields.push_back(line.substr(start));
+	return fields;
+}
+
+/* Endpoints are counted without their ids, so /api/v1/users/42 is /api/v1/users. */
+std::string normalise(const std::string &path)
+{
+	std::string result;
+	std::vector<std::string> parts = split(path, '/');
+
+	for (const std::string &part : parts)
+	{
+		if (part.empty() || (part[0] >= '0' && part[0] <= '9'))
+			continue;
+		result += '/';
+		result += part;
+	}
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	long lines = DEFAULT_LINES, batch = DEFAULT_BATCH;
+
+	if (argc > 1) lines = atol(argv[1]);
+	if (argc > 2) batch = atol(argv[2]);
+	if (argc > 3) rng_state = strtoull(argv[3], NULL, 0) | 1;
+
+	if (lines < 1 || batch < 1)
+	{
+		printf("Usage: %s [lines [batch [seed]]]\n", argv[0]);
+		return 1;
+	}
+
+	std::map<std::string, endpoint_stats> endpoints;
+	std::unordered_map<std::string, long> levels_by_service;
+	long kept = 0, generated = 0;
+
+	double start = now();
+
+	while (generated < lines)
+	{
+		std::vector<std::string> raw;
+		for (long i = 0; i < batch && generated < lines; i++)
+			raw.push_back(generate_line(generated++));
+
+		std::vector<std::string> output;
+		for (const std::string &line : raw)
+		{
+			std::vector<std::string> fields = split(line, ' ');
+			if (fields.size() < 3 || fields[1] == "DEBUG")
+				continue;
+
+			std::vector<std::pair<std::string, std::string>> pairs;
+			for (size_t i = 3; i < fields.size(); i++)
+			{
+				size_t equals = fields[i].find('=');
+				if (equals != std::string::npos)
+					pairs.push_back(std::make_pair(fields[i].substr(0, equals), fields[i].substr(equals + 1)));
+			}
+
+			std::string path, status, latency;
+			for (const auto &pair : pairs)
+			{
+				if (pair.first == "path")
+					path = normalise(pair.second);
+				else if (pair.first == "status")
+					status = pair.second;
+				else if (pair.first == "latency_ms")
+					latency = pair.second;
+			}
+
+			endpoint_stats &stats = endpoints[fields[2] + path];
+			stats.requests++;
+			stats.errors += status != "200";
+			stats.total_latency += atol(latency.c_str());
+			levels_by_service[fields[2] + ":" + fields[1]]++;
+
+			std::string csv = fields[0];
+			csv += ',';
+			csv += fields[2];
+			csv += ',';
+			csv += path;
+			csv += ',';
+			csv += status;
+			csv += ',';
+			csv += latency;
+			output.push_back(csv);
+			kept++;
+		}
+
+		size_t bytes = 0;
+		for (const std::string &csv : output)
+			bytes += csv.size();
+		sink += bytes;
+	}
+
+	double elapsed = now() - start;
+
+	printf("[logs]: LINES: %ld\n", generated);
+	printf("[logs]: KEPT: %ld\n", kept);
+	printf("[logs]: ENDPOINTS: %zu\n", endpoints.size());
+	printf("[logs]: WALL: %f\n", elapsed);
+	printf("[logs]: LINES_PER_SECOND: %.0f\n", generated / elapsed);
+	return 0;
+}
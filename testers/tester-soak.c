@@ -0,0 +1,171 @@
+/*
+ * soak: hours of steady churn, to find fragmentation that only shows late.
+ * Fills a live set up to a fixed number of bytes, then keeps replacing a
+ * random block in it with a new one until the time is up.  The live bytes
+ * stay level, so a heap that keeps growing is the allocator drifting.
+ *
+ * Usage: tester-soak [seconds [live-bytes [min-size [max-size [distribution [interval [seed]]]]]]]
+ *
+ * Block sizes are drawn between min-size and max-size, uniform, loguniform
+ * (as many small blocks as big ones per power of two) or exponential (mean
+ * a quarter of the way up).  Every interval seconds it prints the heap
+ * extent, the resident set and the live bytes, and at the end how much
+ * the heap grew after the first interval.
+ *
+ * The default run is short; a real soak goes past mcontest's time limit,
+ * so turn it off:  mcontest -t 0 ./tester-soak 14400
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "common.h"
+
+#define DEFAULT_SECONDS 10
+#define DEFAULT_LIVE_BYTES (16UL * 1024 * 1024)
+#define DEFAULT_MIN_SIZE 16
+#define DEFAULT_MAX_SIZE 4096
+#define DEFAULT_INTERVAL 1
+
+/* The clock is read once per this many operations. */
+#define CLOCK_EVERY 1024
+
+enum { DIST_UNIFORM, DIST_LOGUNIFORM, DIST_EXPONENTIAL };
+
+size_t min_size = DEFAULT_MIN_SIZE;
+size_t max_size = DEFAULT_MAX_SIZE;
+int distribution = DIST_UNIFORM;
+
+/* Uniform in [0, 1). */
+double rng_unit()
+{
+	return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+size_t draw_size()
+{
+	double size;
+
+	if (distribution == DIST_LOGUNIFORM)
+		size = min_size * pow((double)max_size / min_size, rng_unit());
+	else if (distribution == DIST_EXPONENTIAL)
+		size = min_size - (max_size - min_size) / 4.0 * log(1.0 - rng_unit());
+	else
+		size = min_size + rng_unit() * (max_size - min_size + 1);
+
+	return size > max_size ? max_size : (size_t)size;
+}
+
+size_t resident()
+{
+	unsigned long pages = 0, rss = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+
+	if (statm)
+	{
+		if (fscanf(statm, "%lu %lu", &pages, &rss) != 2)
+			rss = 0;
+		fclose(statm);
+	}
+	return rss * sysconf(_SC_PAGESIZE);
+}
+
+char *allocate(size_t size)
+{
+	char *block = malloc(size);
+	if (block == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+	block[0] = block[size - 1] = (char)size;
+	return block;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = DEFAULT_SECONDS, interval = DEFAULT_INTERVAL;
+	size_t target = DEFAULT_LIVE_BYTES;
+	const char *dist_name = "uniform";
+
+	if (argc > 1) seconds = atof(argv[1]);
+	if (argc > 2) target = strtoul(argv[2], NULL, 0);
+	if (argc > 3) min_size = strtoul(argv[3], NULL, 0);
+	if (argc > 4) max_size = strtoul(argv[4], NULL, 0);
+	if (argc > 5) dist_name = argv[5];
+	if (argc > 6) interval = atof(argv[6]);
+	if (argc > 7) rng_state = strtoull(argv[7], NULL, 0) | 1;
+
+	if (strcmp(dist_name, "uniform") == 0)
+		distribution = DIST_UNIFORM;
+	else if (strcmp(dist_name, "loguniform") == 0)
+		distribution = DIST_LOGUNIFORM;
+	else if (strcmp(dist_name, "exponential") == 0)
+		distribution = DIST_EXPONENTIAL;
+	else
+		distribution = -1;
+
+	if (seconds <= 0 || interval <= 0 || min_size < 1 || max_size < min_size || target < max_size || distribution < 0)
+	{
+		printf("Usage: %s [seconds [live-bytes [min-size [max-size [uniform | loguniform | exponential [interval [seed]]]]]]]\n", argv[0]);
+		return 1;
+	}
+
+	printf("[soak]: LIVE_TARGET: %zu\n", target);
+	char *heap_start = heap_mark();
+
+	/* Every block is at least min_size, so this many slots always hold the target. */
+	long capacity = target / min_size + 1, slots = 0, i;
+	char **blocks = map(capacity * sizeof(char *));
+	size_t *sizes = map(capacity * sizeof(size_t));
+	size_t live = 0;
+
+	while (live < target)
+	{
+		sizes[slots] = draw_size();
+		blocks[slots] = allocate(sizes[slots]);
+		live += sizes[slots++];
+	}
+
+	double start = now(), next_report = start + interval, end = start + seconds, t = start;
+	unsigned long long ops = 0;
+	long first_extent = -1;
+
+	while (t < end)
+	{
+		for (i = 0; i < CLOCK_EVERY; i++)
+		{
+			long victim = rng_next() % slots;
+			free(blocks[victim]);
+			live -= sizes[victim];
+
+			sizes[victim] = draw_size();
+			blocks[victim] = allocate(sizes[victim]);
+			live += sizes[victim];
+		}
+		ops += CLOCK_EVERY;
+
+		t = now();
+		if (t >= next_report || t >= end)
+		{
+			long extent = (char *)sbrk(0) - heap_start;
+			if (first_extent < 0)
+				first_extent = extent;
+
+			printf("[soak]: TIME: %.1f OPS: %llu LIVE: %zu HEAP_EXTENT: %ld RSS: %zu\n",
+			       t - start, ops, live, extent, resident());
+			fflush(stdout);
+			next_report += interval;
+		}
+	}
+
+	printf("[soak]: HEAP_GROWTH: %ld\n", (long)((char *)sbrk(0) - heap_start) - first_extent);
+
+	for (i = 0; i < slots; i++)
+		free(blocks[i]);
+	return 0;
+}
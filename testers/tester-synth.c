@@ -0,0 +1,543 @@
+/*
+ * synth: a synthetic workload built from a description rather than written
+ * as a program, so a service's allocation profile can be modelled and
+ * replayed against an allocator.
+ *
+ * Usage: tester-synth [key=value | spec-file]...
+ *
+ * Settings are given as key=value arguments, or as key = value lines in a
+ * spec file named instead (# starts a comment).  Later settings override
+ * earlier ones.
+ *
+ *   ops=N          allocations to make, split between the threads (100000)
+ *   threads=N      threads to run (1)
+ *   seed=N         random seed; the same seed gives the same workload (1)
+ *   size=DIST      size of each new block, in bytes (uniform:24,102400)
+ *   lifetime=DIST  allocations the thread makes before the block is freed;
+ *                  0 frees it at once, inf keeps it to the end (exponential:100)
+ *   realloc=P      chance that an operation resizes a live block instead of
+ *                  allocating a new one (0)
+ *   growth=DIST    factor a resized block's size is multiplied by (2)
+ *   touch=MODE     none, ends (first and last byte) or all (ends)
+ *
+ * A DIST is one of:
+ *
+ *   N                      always N
+ *   uniform:MIN,MAX        uniform between MIN and MAX
+ *   exponential:MEAN       exponential with the given mean
+ *   lognormal:MEDIAN,SIGMA log-normal; SIGMA is that of the underlying normal
+ *   powerlaw:MIN,MAX,ALPHA Pareto with shape ALPHA, cut off at MIN and MAX
+ *   bimodal:A,B,P          B with chance P, otherwise A
+ *   empirical:FILE         drawn from a histogram: lines of "size count" or
+ *                          "low-high count", or the SIZE lines of mcontest -p
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+enum { DIST_CONSTANT, DIST_UNIFORM, DIST_EXPONENTIAL, DIST_LOGNORMAL, DIST_POWERLAW, DIST_BIMODAL, DIST_EMPIRICAL };
+
+#define MAX_BINS 1024
+
+typedef struct _dist_t
+{
+	int kind;
+	double a, b, c;
+
+	/* Empirical: bin i covers [low[i], high[i]], chosen with weight[i]. */
+	int bins;
+	double low[MAX_BINS], high[MAX_BINS], cumulative[MAX_BINS];
+} dist_t;
+
+enum { TOUCH_NONE, TOUCH_ENDS, TOUCH_ALL };
+
+long ops = 100000;
+int threads = 1;
+unsigned long long seed = 1;
+dist_t size_dist, lifetime_dist, growth_dist;
+double realloc_chance = 0;
+int touch = TOUCH_ENDS;
+
+char size_spec[256] = "uniform:24,102400";
+char lifetime_spec[256] = "exponential:100";
+char growth_spec[256] = "2";
+
+/*
+ * xorshift64*: small, fast, and the same sequence on every platform, which
+ * rand() does not promise.  Every thread has its own.
+ */
+typedef struct _rng_t
+{
+	unsigned long long state;
+} rng_t;
+
+unsigned long long rng_next(rng_t *rng)
+{
+	rng->state ^= rng->state >> 12;
+	rng->state ^= rng->state << 25;
+	rng->state ^= rng->state >> 27;
+	return rng->state * 2685821657736338717ULL;
+}
+
+/* Uniform on (0, 1). */
+double rng_uniform(rng_t *rng)
+{
+	return ((rng_next(rng) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+double rng_normal(rng_t *rng)
+{
+	return sqrt(-2 * log(rng_uniform(rng))) * cos(2 * M_PI * rng_uniform(rng));
+}
+
+double sample(dist_t *dist, rng_t *rng)
+{
+	double u;
+	int i;
+
+	switch (dist->kind)
+	{
+		case DIST_CONSTANT:
+			return dist->a;
+		case DIST_UNIFORM:
+			return dist->a + (dist->b - dist->a) * rng_uniform(rng);
+		case DIST_EXPONENTIAL:
+			return -dist->a * log(rng_uniform(rng));
+		case DIST_LOGNORMAL:
+			return exp(log(dist->a) + dist->b * rng_normal(rng));
+		case DIST_POWERLAW:
+			/* Inverse of the truncated Pareto distribution function. */
+			u = rng_uniform(rng);
+			return pow(pow(dist->a, -dist->c) - u * (pow(dist->a, -dist->c) - pow(dist->b, -dist->c)), -1 / dist->c);
+		case DIST_BIMODAL:
+			return rng_uniform(rng) < dist->c ? dist->b : dist->a;
+		case DIST_EMPIRICAL:
+			u = rng_uniform(rng) * dist->cumulative[dist->bins - 1];
+			for (i = 0; i < dist->bins - 1 && dist->cumulative[i] < u; i++)
+				;
+			return dist->low[i] + (dist->high[i] - dist->low[i]) * rng_uniform(rng);
+	}
+
+	return 0;
+}
+
+int load_histogram(dist_t *dist, const char *file_name)
+{
+	char line[512];
+	FILE *file = fopen(file_name, "r");
+	if (!file)
+	{
+		perror(file_name);
+		return 1;
+	}
+
+	dist->bins = 0;
+	while (fgets(line, sizeof(line), file) && dist->bins < MAX_BINS)
+	{
+		double low, high, count;
+
+		/* mcontest -p prints "[mcontest]: SIZE: low-high: count (percent)". */
+		char *text = strstr(line, "SIZE: ");
+		text = text ? text + 6 : line;
+
+		if (sscanf(text, "%lf-%lf%*[: ]%lf", &low, &high, &count) == 3)
+			;
+		else if (sscanf(text, "%lf+:%lf", &low, &count) == 2)
+			high = low;
+		else if (sscanf(text, "%lf %lf", &low, &count) == 2)
+			high = low;
+		else
+			continue;
+
+		if (count <= 0)
+			continue;
+
+		dist->low[dist->bins] = low;
+		dist->high[dist->bins] = high;
+		dist->cumulative[dist->bins] = count + (dist->bins ? dist->cumulative[dist->bins - 1] : 0);
+		dist->bins++;
+	}
+
+	fclose(file);
+	if (dist->bins == 0)
+	{
+		fprintf(stderr, "%s: no histogram lines found\n", file_name);
+		return 1;
+	}
+
+	return 0;
+}
+
+int parse_dist(dist_t *dist, const char *spec)
+{
+	const char *args = strchr(spec, ':');
+	int n = args ? sscanf(args + 1, "%lf,%lf,%lf", &dist->a, &dist->b, &dist->c) : 0;
+
+	if (!args)
+	{
+		char *end;
+		dist->kind = DIST_CONSTANT;
+		dist->a = strtod(spec, &end);
+		return *spec == '\0' || *end != '\0';
+	}
+
+	if (strncmp(spec, "uniform:", 8) == 0)
+		dist->kind = DIST_UNIFORM;
+	else if (strncmp(spec, "exponential:", 12) == 0)
+		dist->kind = DIST_EXPONENTIAL;
+	else if (strncmp(spec, "lognormal:", 10) == 0)
+		dist->kind = DIST_LOGNORMAL;
+	else if (strncmp(spec, "powerlaw:", 9) == 0)
+		dist->kind = DIST_POWERLAW;
+	else if (strncmp(spec, "bimodal:", 8) == 0)
+		dist->kind = DIST_BIMODAL;
+	else if (strncmp(spec, "empirical:", 10) == 0)
+	{
+		dist->kind = DIST_EMPIRICAL;
+		return load_histogram(dist, args + 1);
+	}
+	else
+		return 1;
+
+	switch (dist->kind)
+	{
+		case DIST_UNIFORM: return n != 2 || dist->b < dist->a;
+		case DIST_EXPONENTIAL: return n != 1 || dist->a <= 0;
+		case DIST_LOGNORMAL: return n != 2 || dist->a <= 0 || dist->b < 0;
+		case DIST_POWERLAW: return n != 3 || dist->a <= 0 || dist->b < dist->a || dist->c <= 0;
+		case DIST_BIMODAL: return n != 3 || dist->c < 0 || dist->c > 1;
+	}
+
+	return 0;
+}
+
+int set(const char *key, const char *value)
+{
+	if (strcmp(key, "ops") == 0)
+		ops = atol(value);
+	else if (strcmp(key, "threads") == 0)
+		threads = atoi(value);
+	else if (strcmp(key, "seed") == 0)
+		seed = strtoull(value, NULL, 0);
+	else if (strcmp(key, "size") == 0)
+		snprintf(size_spec, sizeof(size_spec), "%s", value);
+	else if (strcmp(key, "lifetime") == 0)
+		snprintf(lifetime_spec, sizeof(lifetime_spec), "%s", value);
+	else if (strcmp(key, "growth") == 0)
+		snprintf(growth_spec, sizeof(growth_spec), "%s", value);
+	else if (strcmp(key, "realloc") == 0)
+		realloc_chance = atof(value);
+	else if (strcmp(key, "touch") == 0)
+	{
+		if (strcmp(value, "none") == 0)
+			touch = TOUCH_NONE;
+		else if (strcmp(value, "ends") == 0)
+			touch = TOUCH_ENDS;
+		else if (strcmp(value, "all") == 0)
+			touch = TOUCH_ALL;
+		else
+			return 1;
+	}
+	else
+		return 1;
+
+	return 0;
+}
+
+/* Splits "key = value" (or "key=value") in place and applies it. */
+int set_line(char *line)
+{
+	char *equals = strchr(line, '=');
+	if (!equals)
+		return 1;
+
+	char *key = line, *value = equals + 1;
+	char *end = equals;
+	*equals = '\0';
+
+	while (*key == ' ' || *key == '\t')
+		key++;
+	while (end > key && (end[-1] == ' ' || end[-1] == '\t'))
+		*--end = '\0';
+	while (*value == ' ' || *value == '\t')
+		value++;
+	value[strcspn(value, " \t\r\n")] = '\0';
+
+	if (set(key, value) != 0)
+	{
+		fprintf(stderr, "Invalid setting: %s=%s\n", key, value);
+		return 1;
+	}
+
+	return 0;
+}
+
+int load_spec(const char *file_name)
+{
+	char line[512];
+	FILE *file = fopen(file_name, "r");
+	if (!file)
+	{
+		perror(file_name);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), file))
+	{
+		line[strcspn(line, "#\r\n")] = '\0';
+		if (line[strspn(line, " \t")] == '\0')
+			continue;
+
+		if (set_line(line) != 0)
+		{
+			fclose(file);
+			return 1;
+		}
+	}
+
+	fclose(file);
+	return 0;
+}
+
+/*
+ * Every thread keeps its live blocks in a binary heap ordered by the
+ * operation at which each is to be freed.  The heap is also the list of
+ * live blocks to pick from for realloc().  It lives in its own mapping so
+ * that the only allocations the allocator sees are the modelled ones.
+ */
+typedef struct _block_t
+{
+	double death;
+	char *ptr;
+	size_t size;
+} block_t;
+
+typedef struct _heap_t
+{
+	block_t *blocks;
+	long count, capacity;
+} heap_t;
+
+void heap_push(heap_t *heap, block_t block)
+{
+	if (heap->count == heap->capacity)
+	{
+		long capacity = heap->capacity ? heap->capacity * 2 : 4096;
+		void *blocks = heap->blocks ?
+			mremap(heap->blocks, heap->capacity * sizeof(block_t), capacity * sizeof(block_t), MREMAP_MAYMOVE) :
+			mmap(NULL, capacity * sizeof(block_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (blocks == MAP_FAILED)
+		{
+			perror("mmap");
+			exit(1);
+		}
+		heap->blocks = blocks;
+		heap->capacity = capacity;
+	}
+
+	long i = heap->count++;
+	while (i > 0 && heap->blocks[(i - 1) / 2].death > block.death)
+	{
+		heap->blocks[i] = heap->blocks[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap->blocks[i] = block;
+}
+
+block_t heap_pop(heap_t *heap)
+{
+	block_t top = heap->blocks[0];
+	block_t last = heap->blocks[--heap->count];
+	long i = 0;
+
+	for (;;)
+	{
+		long child = 2 * i + 1;
+		if (child >= heap->count)
+			break;
+		if (child + 1 < heap->count && heap->blocks[child + 1].death < heap->blocks[child].death)
+			child++;
+		if (heap->blocks[child].death >= last.death)
+			break;
+		heap->blocks[i] = heap->blocks[child];
+		i = child;
+	}
+	heap->blocks[i] = last;
+
+	return top;
+}
+
+size_t clamp_size(double size)
+{
+	if (size < 1)
+		return 1;
+	if (size > 1e12)
+		return (size_t)1e12;
+	return (size_t)size;
+}
+
+void use(char *ptr, size_t size)
+{
+	if (touch == TOUCH_ENDS)
+		ptr[0] = ptr[size - 1] = (char)size;
+	else if (touch == TOUCH_ALL)
+		memset(ptr, (char)size, size);
+}
+
+typedef struct _thread_t
+{
+	pthread_t id;
+	rng_t rng;
+	long ops;
+	long reallocs;
+	unsigned long long peak_live;
+} thread_t;
+
+void *worker(void *arg)
+{
+	thread_t *thread = arg;
+	heap_t heap = { NULL, 0, 0 };
+	unsigned long long live = 0;
+	long op;
+
+	for (op = 0; op < thread->ops; op++)
+	{
+		while (heap.count > 0 && heap.blocks[0].death <= op)
+		{
+			block_t block = heap_pop(&heap);
+			live -= block.size;
+			free(block.ptr);
+		}
+
+		/* A resize keeps the block's place in the heap, so its death too. */
+		if (heap.count > 0 && realloc_chance > 0 && rng_uniform(&thread->rng) < realloc_chance)
+		{
+			block_t *block = &heap.blocks[rng_next(&thread->rng) % heap.count];
+			size_t size = clamp_size(block->size * sample(&growth_dist, &thread->rng));
+
+			char *ptr = realloc(block->ptr, size);
+			if (ptr == NULL)
+			{
+				printf("Memory failed to allocate!\n");
+				exit(1);
+			}
+
+			live += size - block->size;
+			block->ptr = ptr;
+			block->size = size;
+			use(ptr, size);
+			thread->reallocs++;
+		}
+		else
+		{
+			size_t size = clamp_size(sample(&size_dist, &thread->rng));
+			double lifetime = sample(&lifetime_dist, &thread->rng);
+
+			char *ptr = malloc(size);
+			if (ptr == NULL)
+			{
+				printf("Memory failed to allocate!\n");
+				exit(1);
+			}
+			use(ptr, size);
+
+			if (lifetime < 1)
+				free(ptr);
+			else
+			{
+				block_t block = { op + lifetime, ptr, size };
+				heap_push(&heap, block);
+				live += size;
+			}
+		}
+
+		if (live > thread->peak_live)
+			thread->peak_live = live;
+	}
+
+	while (heap.count > 0)
+		free(heap_pop(&heap).ptr);
+	if (heap.blocks)
+		munmap(heap.blocks, heap.capacity * sizeof(block_t));
+
+	return NULL;
+}
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; i++)
+	{
+		char arg[512];
+		snprintf(arg, sizeof(arg), "%s", argv[i]);
+
+		if (strchr(arg, '=') ? set_line(arg) : load_spec(arg))
+		{
+			printf("Usage: %s [key=value | spec-file]...\n", argv[0]);
+			printf("Keys: ops threads seed size lifetime realloc growth touch (see testers/tester-synth.c)\n");
+			return 1;
+		}
+	}
+
+	if (parse_dist(&size_dist, size_spec) || parse_dist(&lifetime_dist, lifetime_spec) || parse_dist(&growth_dist, growth_spec))
+	{
+		fprintf(stderr, "Invalid distribution in size=%s lifetime=%s growth=%s\n", size_spec, lifetime_spec, growth_spec);
+		return 1;
+	}
+
+	if (ops < 1 || threads < 1)
+	{
+		fprintf(stderr, "ops and threads must be at least 1\n");
+		return 1;
+	}
+
+	thread_t *workers = calloc(threads, sizeof(thread_t));
+	for (i = 0; i < threads; i++)
+	{
+		/* Mix the seed so neighbouring threads do not start out alike. */
+		workers[i].rng.state = (seed + i) * 0x9E3779B97F4A7C15ULL | 1;
+		workers[i].ops = ops / threads + (i < ops % threads);
+	}
+
+	double start = now();
+	for (i = 0; i < threads; i++)
+		pthread_create(&workers[i].id, NULL, worker, &workers[i]);
+
+	long reallocs = 0;
+	unsigned long long peak_live = 0;
+	for (i = 0; i < threads; i++)
+	{
+		pthread_join(workers[i].id, NULL);
+		reallocs += workers[i].reallocs;
+		peak_live += workers[i].peak_live;
+	}
+	double elapsed = now() - start;
+
+	/* Every allocation is freed again; resizes are one call each. */
+	double calls = 2.0 * (ops - reallocs) + reallocs;
+
+	printf("[synth]: SPEC: ops=%ld threads=%d seed=%llu size=%s lifetime=%s realloc=%g growth=%s\n",
+	       ops, threads, seed, size_spec, lifetime_spec, realloc_chance, growth_spec);
+	printf("[synth]: REALLOCS: %ld\n", reallocs);
+	/* The sum of every thread's own peak, so at least the real peak. */
+	printf("[synth]: PEAK_LIVE: %llu\n", peak_live);
+	printf("[synth]: OPS: %.0f\n", calls);
+	printf("[synth]: WALL: %f\n", elapsed);
+	printf("[synth]: OPS_PER_SECOND: %.0f\n", calls / elapsed);
+
+	free(workers);
+	return 0;
+}
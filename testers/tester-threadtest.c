@@ -0,0 +1,94 @@
+/*
+ * threadtest: every thread allocates a batch of objects and frees them all
+ * again, over and over, never touching another thread's blocks.  It shows
+ * how the allocator scales when threads share nothing.  (After the
+ * threadtest benchmark that comes with Hoard.)
+ *
+ * Usage: tester-threadtest [threads [iterations [objects [size]]]]
+ *
+ * The objects are split evenly between the threads, so the work done is the
+ * same whatever the thread count.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "common.h"
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_ITERATIONS 50
+#define DEFAULT_OBJECTS 30000
+#define DEFAULT_SIZE 8
+
+int iterations = DEFAULT_ITERATIONS;
+int objects_per_thread;
+int object_size = DEFAULT_SIZE;
+
+void *worker(void *arg)
+{
+	int i, j;
+	char **objects = malloc(objects_per_thread * sizeof(char *));
+
+	if (objects == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+
+	for (i = 0; i < iterations; i++)
+	{
+		for (j = 0; j < objects_per_thread; j++)
+		{
+			objects[j] = malloc(object_size);
+			if (objects[j] == NULL)
+			{
+				printf("Memory failed to allocate!\n");
+				exit(1);
+			}
+			objects[j][0] = (char)j;
+		}
+
+		for (j = 0; j < objects_per_thread; j++)
+			free(objects[j]);
+	}
+
+	free(objects);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int i, threads = DEFAULT_THREADS, objects = DEFAULT_OBJECTS;
+
+	if (argc > 1) threads = atoi(argv[1]);
+	if (argc > 2) iterations = atoi(argv[2]);
+	if (argc > 3) objects = atoi(argv[3]);
+	if (argc > 4) object_size = atoi(argv[4]);
+
+	if (threads < 1 || iterations < 1 || objects < threads || object_size < 1)
+	{
+		printf("Usage: %s [threads [iterations [objects [size]]]]\n", argv[0]);
+		return 1;
+	}
+
+	objects_per_thread = objects / threads;
+	pthread_t *ids = malloc(threads * sizeof(pthread_t));
+
+	double start = now();
+	for (i = 0; i < threads; i++)
+		pthread_create(&ids[i], NULL, worker, NULL);
+	for (i = 0; i < threads; i++)
+		pthread_join(ids[i], NULL);
+	double elapsed = now() - start;
+
+	/* A malloc() and a free() for every object in every iteration. */
+	double ops = 2.0 * iterations * objects_per_thread * threads;
+
+	printf("[threadtest]: THREADS: %d\n", threads);
+	printf("[threadtest]: OPS: %.0f\n", ops);
+	printf("[threadtest]: WALL: %f\n", elapsed);
+	printf("[threadtest]: OPS_PER_SECOND: %.0f\n", ops / elapsed);
+
+	free(ids);
+	return 0;
+}
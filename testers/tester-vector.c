@@ -0,0 +1,206 @@
+/*
+ * vector: dynamic arrays, the commonest user of realloc().  Many vectors
+ * grow one element at a time, each by 2x or 1.5x when it is full, pushed
+ * to in random turn and with unrelated blocks allocated and freed between
+ * the pushes, so a vector's neighbour is rarely free to grow into.  After
+ * each growth phase every vector is shrunk to fit, half its elements are
+ * popped, and it is shrunk to fit again.
+ *
+ * Usage: tester-vector [vectors [elements [rounds [seed]]]]
+ *
+ * elements is the total pushed per round, across all the vectors.  Every
+ * vector's contents are checked after each phase.  The tester counts the
+ * reallocations that moved and the bytes they could have had to copy; if
+ * the allocator exports alloc_realloc_stats(), as alloc.so does, what it
+ * says it did is reported too.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include "common.h"
+
+#define DEFAULT_VECTORS 64
+#define DEFAULT_ELEMENTS 2000000
+#define DEFAULT_ROUNDS 3
+
+#define INITIAL_CAPACITY 4
+#define OTHER_SLOTS 256
+#define OTHER_EVERY 8
+#define OTHER_MIN_SIZE 16
+#define OTHER_MAX_SIZE 512
+
+typedef struct _vector_t
+{
+	long *data;
+	long size, capacity;
+	int grow_by_half;
+} vector_t;
+
+typedef void (*realloc_stats_t)(unsigned long *grown, unsigned long *shrunk, unsigned long *moved, unsigned long long *copied);
+
+void *others[OTHER_SLOTS];
+
+unsigned long reallocs, moves;
+unsigned long long copied_at_most;
+
+/* What element i of vector v holds, so contents can be checked after any move. */
+long expected(long v, long i)
+{
+	return v * 1000003 + i;
+}
+
+void resize(vector_t *vector, long capacity)
+{
+	long *data = realloc(vector->data, capacity * sizeof(long));
+
+	if (data == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+
+	reallocs++;
+	if (vector->data && data != vector->data)
+	{
+		moves++;
+		copied_at_most += vector->capacity * sizeof(long);
+	}
+
+	vector->data = data;
+	vector->capacity = capacity;
+}
+
+void push(vector_t *vector, long v)
+{
+	if (vector->size == vector->capacity)
+	{
+		long capacity = vector->grow_by_half ? vector->capacity + vector->capacity / 2 : vector->capacity * 2;
+		resize(vector, capacity > INITIAL_CAPACITY ? capacity : INITIAL_CAPACITY);
+	}
+	vector->data[vector->size] = expected(v, vector->size);
+	vector->size++;
+}
+
+void shrink_to_fit(vector_t *vector)
+{
+	if (vector->size > 0 && vector->size < vector->capacity)
+		resize(vector, vector->size);
+}
+
+void other()
+{
+	int slot = rng_next() % OTHER_SLOTS;
+	free(others[slot]);
+
+	size_t size = OTHER_MIN_SIZE + rng_next() % (OTHER_MAX_SIZE - OTHER_MIN_SIZE + 1);
+	others[slot] = malloc(size);
+	if (others[slot] == NULL)
+	{
+		printf("Memory failed to allocate!\n");
+		exit(1);
+	}
+	memset(others[slot], 0, size);
+}
+
+void verify(vector_t *vectors, long count, const char *phase)
+{
+	long v, i;
+
+	for (v = 0; v < count; v++)
+	{
+		for (i = 0; i < vectors[v].size; i++)
+		{
+			if (vectors[v].data[i] != expected(v, i))
+			{
+				printf("[vector]: Vector %ld element %ld is wrong after %s\n", v, i, phase);
+				exit(1);
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	long v, i, count = DEFAULT_VECTORS, elements = DEFAULT_ELEMENTS;
+	int round, rounds = DEFAULT_ROUNDS;
+
+	if (argc > 1) count = atol(argv[1]);
+	if (argc > 2) elements = atol(argv[2]);
+	if (argc > 3) rounds = atoi(argv[3]);
+	if (argc > 4) rng_state = strtoull(argv[4], NULL, 0) | 1;
+
+	if (count < 1 || elements < 0 || rounds < 1)
+	{
+		printf("Usage: %s [vectors [elements [rounds [seed]]]]\n", argv[0]);
+		return 1;
+	}
+
+	/* mcontest's shim loads the allocator at the first call, so make one before looking. */
+	void *volatile first = malloc(1);
+	free(first);
+	realloc_stats_t realloc_stats = (realloc_stats_t)dlsym(RTLD_DEFAULT, "alloc_realloc_stats");
+	unsigned long grown_before = 0, shrunk_before = 0, moved_before = 0;
+	unsigned long long copied_before = 0;
+	if (realloc_stats)
+		realloc_stats(&grown_before, &shrunk_before, &moved_before, &copied_before);
+
+	vector_t *vectors = map(count * sizeof(vector_t));
+	for (v = 0; v < count; v++)
+		vectors[v].grow_by_half = v % 2;
+
+	double start = now();
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (i = 0; i < elements; i++)
+		{
+			v = rng_next() % count;
+			push(&vectors[v], v);
+			if (i % OTHER_EVERY == 0)
+				other();
+		}
+
+		verify(vectors, count, "growing");
+
+		for (v = 0; v < count; v++)
+			shrink_to_fit(&vectors[v]);
+		verify(vectors, count, "shrinking to fit");
+
+		for (v = 0; v < count; v++)
+		{
+			vectors[v].size /= 2;
+			shrink_to_fit(&vectors[v]);
+		}
+		verify(vectors, count, "popping half");
+	}
+
+	double elapsed = now() - start;
+
+	printf("[vector]: REALLOCS: %lu\n", reallocs);
+	printf("[vector]: MOVED: %lu\n", moves);
+	printf("[vector]: COPIED_AT_MOST: %llu\n", copied_at_most);
+
+	if (realloc_stats)
+	{
+		unsigned long grown, shrunk, moved;
+		unsigned long long copied;
+		realloc_stats(&grown, &shrunk, &moved, &copied);
+
+		printf("[vector]: ALLOC_GROWN: %lu\n", grown - grown_before);
+		printf("[vector]: ALLOC_SHRUNK: %lu\n", shrunk - shrunk_before);
+		printf("[vector]: ALLOC_MOVED: %lu\n", moved - moved_before);
+		printf("[vector]: ALLOC_COPIED: %llu\n", copied - copied_before);
+	}
+
+	printf("[vector]: WALL: %f\n", elapsed);
+
+	for (v = 0; v < count; v++)
+		free(vectors[v].data);
+	for (i = 0; i < OTHER_SLOTS; i++)
+		free(others[i]);
+	return 0;
+}
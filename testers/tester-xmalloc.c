@@ -0,0 +1,188 @@
+/*
+ * xmalloc: producer/consumer.  Producer threads allocate blocks and pass
+ * them, a batch at a time, through a shared queue to consumer threads,
+ * which free them.  No block is ever freed by the thread that allocated it,
+ * which is the worst case for allocators with per-thread heaps.  (After
+ * xmalloc-test by Lever and Boreham.)
+ *
+ * Usage: tester-xmalloc [threads [blocks [min-size [max-size]]]]
+ *
+ * threads is the number of producers, and as many consumers run alongside
+ * them.  blocks is the total, split evenly between the producers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "common.h"
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_BLOCKS 2000000
+#define DEFAULT_MIN_SIZE 8
+#define DEFAULT_MAX_SIZE 512
+
+#define BATCH_SIZE 256
+#define QUEUE_LENGTH 64
+
+typedef struct _batch_t
+{
+	int count;
+	char *blocks[BATCH_SIZE];
+	struct _batch_t *next;
+} batch_t;
+
+/*
+ * The queue is bounded, so producers that get ahead wait and the heap does
+ * not just grow with the number of blocks.
+ */
+pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t queue_not_full = PTHREAD_COND_INITIALIZER;
+batch_t *queue_head = NULL, *queue_tail = NULL;
+int queue_length = 0;
+int producers_running = 0;
+
+int blocks_per_producer;
+int min_size = DEFAULT_MIN_SIZE;
+int max_size = DEFAULT_MAX_SIZE;
+
+void enqueue(batch_t *batch)
+{
+	pthread_mutex_lock(&queue_lock);
+	while (queue_length >= QUEUE_LENGTH)
+		pthread_cond_wait(&queue_not_full, &queue_lock);
+
+	batch->next = NULL;
+	if (queue_tail)
+		queue_tail->next = batch;
+	else
+		queue_head = batch;
+	queue_tail = batch;
+	queue_length++;
+
+	pthread_cond_signal(&queue_not_empty);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+/* Returns NULL once the queue is empty and every producer is done. */
+batch_t *dequeue()
+{
+	pthread_mutex_lock(&queue_lock);
+	while (!queue_head && producers_running > 0)
+		pthread_cond_wait(&queue_not_empty, &queue_lock);
+
+	batch_t *batch = queue_head;
+	if (batch)
+	{
+		queue_head = batch->next;
+		if (!queue_head)
+			queue_tail = NULL;
+		queue_length--;
+		pthread_cond_signal(&queue_not_full);
+	}
+
+	pthread_mutex_unlock(&queue_lock);
+	return batch;
+}
+
+void *producer(void *arg)
+{
+	int i;
+	unsigned int seed = (unsigned int)(long)arg;
+	batch_t *batch = NULL;
+
+	for (i = 0; i < blocks_per_producer; i++)
+	{
+		if (!batch)
+		{
+			batch = malloc(sizeof(batch_t));
+			if (batch == NULL)
+			{
+				printf("Memory failed to allocate!\n");
+				exit(1);
+			}
+			batch->count = 0;
+		}
+
+		int size = min_size + rand_r(&seed) % (max_size - min_size + 1);
+		char *block = malloc(size);
+		if (block == NULL)
+		{
+			printf("Memory failed to allocate!\n");
+			exit(1);
+		}
+		block[0] = (char)size;
+
+		batch->blocks[batch->count++] = block;
+		if (batch->count == BATCH_SIZE)
+		{
+			enqueue(batch);
+			batch = NULL;
+		}
+	}
+
+	if (batch)
+		enqueue(batch);
+
+	pthread_mutex_lock(&queue_lock);
+	producers_running--;
+	pthread_cond_broadcast(&queue_not_empty);
+	pthread_mutex_unlock(&queue_lock);
+	return NULL;
+}
+
+void *consumer(void *arg)
+{
+	int i;
+	batch_t *batch;
+
+	while ((batch = dequeue()) != NULL)
+	{
+		for (i = 0; i < batch->count; i++)
+			free(batch->blocks[i]);
+		free(batch);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int i, threads = DEFAULT_THREADS, blocks = DEFAULT_BLOCKS;
+
+	if (argc > 1) threads = atoi(argv[1]);
+	if (argc > 2) blocks = atoi(argv[2]);
+	if (argc > 3) min_size = atoi(argv[3]);
+	if (argc > 4) max_size = atoi(argv[4]);
+
+	if (threads < 1 || blocks < threads || min_size < 1 || max_size < min_size)
+	{
+		printf("Usage: %s [threads [blocks [min-size [max-size]]]]\n", argv[0]);
+		return 1;
+	}
+
+	blocks_per_producer = blocks / threads;
+	producers_running = threads;
+	pthread_t *ids = malloc(2 * threads * sizeof(pthread_t));
+
+	double start = now();
+	for (i = 0; i < threads; i++)
+	{
+		pthread_create(&ids[i], NULL, producer, (void *)(long)(i + 1));
+		pthread_create(&ids[threads + i], NULL, consumer, NULL);
+	}
+	for (i = 0; i < 2 * threads; i++)
+		pthread_join(ids[i], NULL);
+	double elapsed = now() - start;
+
+	/* A malloc() and a free() for every block. */
+	double ops = 2.0 * blocks_per_producer * threads;
+
+	printf("[xmalloc]: THREADS: %d\n", threads);
+	printf("[xmalloc]: OPS: %.0f\n", ops);
+	printf("[xmalloc]: WALL: %f\n", elapsed);
+	printf("[xmalloc]: OPS_PER_SECOND: %.0f\n", ops / elapsed);
+
+	free(ids);
+	return 0;
+}